@@ -0,0 +1,320 @@
+// End-to-end benchmark: runs the full optimizer (generation, scoring,
+// refinement, commit, threading) on a fixed synthetic corpus and records
+// PSNR/SSIM against shape count and wall-clock time. The time to reach the
+// target PSNR on each image is compared against a stored baseline and the
+// run fails when it regressed by more than the threshold.
+//
+//   make bench-e2e CXXFLAGS=-O2
+//   make bench-e2e CXXFLAGS=-O2 ARGS="--update-baseline"
+//
+// Options: --shapes N (budget per image), --target DB, --threshold FRACTION,
+// --reps N (median run per image), --threads N, --seed N, --rect-batch N,
+// --cache N, --prune, --quadtree N, --init black|mean|subdivide|superpixel,
+// --sample N (curve resolution in shapes), --baseline PATH, --curves PATH,
+// --image PATH (adds a file to the corpus), --update-baseline (writes the
+// baseline instead of checking it).
+//
+// Shapes count search iterations; the time includes setting up the
+// optimizer, warm start and all.
+//
+// Baselines hold wall-clock times, so they are only meaningful on the
+// machine that recorded them, and none is checked in: record one with
+// --update-baseline first. Without a baseline the run fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../include/raylib.h"
+#include "../src/Optimizer.hpp"
+
+struct E2eOptions {
+  int shapes = 3000;
+  float target = 30.0f;
+  float threshold = 0.15f;
+  int reps = 3;
+  int threads = 0;
+  int rectBatch = -1; // -1 keeps the OptimizerSettings default
+  int cache = -1;
+  bool prune = false;
+  int quadtree = -1;
+  int init = -1;
+  unsigned long long seed = 1;
+  int sample = 25;
+  std::string baseline = "bench/baseline.csv";
+  std::string curves = "e2e_curves.csv";
+  std::vector<std::string> images;
+  bool updateBaseline = false;
+};
+
+struct E2eResult {
+  std::string name;
+  int shapesToTarget = -1; // -1 when the target was not reached
+  double msToTarget = -1.0;
+  float finalPsnr = 0.0f;
+};
+
+struct CorpusImage {
+  std::string name;
+  Image image;
+};
+
+// Fixed images, generated rather than stored so the corpus needs no assets.
+static std::vector<CorpusImage> BuildCorpus(const E2eOptions& opt) {
+  const int w = 320;
+  const int h = 240;
+  std::vector<CorpusImage> corpus;
+  SetRandomSeed((unsigned int)opt.seed);
+
+  corpus.push_back({"radial", GenImageGradientRadial(w, h, 0.3f, ORANGE, DARKBLUE)});
+  corpus.push_back({"checked", GenImageChecked(w, h, 40, 40, MAROON, BEIGE)});
+  corpus.push_back({"cellular", GenImageCellular(w, h, 32)});
+  corpus.push_back({"perlin", GenImagePerlinNoise(w, h, 0, 0, 4.0f)});
+
+  for (const std::string& path : opt.images) {
+    Image img = LoadImage(path.c_str());
+    if (img.data) {
+      corpus.push_back({path, img});
+    } else {
+      fprintf(stderr, "skipping %s: cannot load\n", path.c_str());
+    }
+  }
+
+  for (CorpusImage& c : corpus) {
+    ImageFormat(&c.image, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  }
+  return corpus;
+}
+
+static E2eResult RunImage(const E2eOptions& opt, const CorpusImage& img, FILE* curves) {
+  E2eResult result;
+  result.name = img.name;
+
+  OptimizerSettings settings;
+  settings.threads = opt.threads;
+  settings.seed = opt.seed;
+  if (opt.rectBatch >= 0) {
+    settings.rectangleBatch = opt.rectBatch;
+  }
+  if (opt.cache >= 0) {
+    settings.candidateCache = opt.cache;
+  }
+  settings.pruneCandidates = opt.prune;
+  if (opt.quadtree >= 0) {
+    settings.quadtreeCandidates = opt.quadtree;
+  }
+  if (opt.init >= 0) {
+    settings.init = (CanvasInit)opt.init;
+  }
+
+  auto setup = std::chrono::steady_clock::now();
+  Optimizer optimizer;
+  InitOptimizer(optimizer, img.image, settings);
+  double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setup).count();
+
+  for (int shape = 1; shape <= opt.shapes; shape++) {
+    auto start = std::chrono::steady_clock::now();
+    StepOptimizer(optimizer);
+    elapsed += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    float psnr = (float)TelemetryPsnr(optimizer.telemetry);
+    bool reached = psnr >= opt.target && result.shapesToTarget < 0;
+    if (reached) {
+      result.shapesToTarget = shape;
+      result.msToTarget = elapsed;
+    }
+
+    if (curves && (shape % opt.sample == 0 || reached || shape == opt.shapes)) {
+      fprintf(curves, "%s,%d,%.3f,%.4f,%.4f,%.5f\n", img.name.c_str(), shape, elapsed,
+              TelemetryMse(optimizer.telemetry), psnr, MeanSsim(optimizer.ssim));
+    }
+    if (result.shapesToTarget >= 0) {
+      break;
+    }
+  }
+
+  result.finalPsnr = (float)TelemetryPsnr(optimizer.telemetry);
+  UnloadOptimizer(optimizer);
+  return result;
+}
+
+static std::map<std::string, E2eResult> LoadBaseline(const std::string& path, float& target) {
+  std::map<std::string, E2eResult> baseline;
+  FILE* f = fopen(path.c_str(), "r");
+  if (!f) {
+    return baseline;
+  }
+
+  char line[1024];
+  fgets(line, sizeof(line), f); // header
+  while (fgets(line, sizeof(line), f)) {
+    char name[512];
+    E2eResult r;
+    if (sscanf(line, "%511[^,],%f,%d,%lf,%f", name, &target, &r.shapesToTarget, &r.msToTarget, &r.finalPsnr) == 5) {
+      r.name = name;
+      baseline[r.name] = r;
+    }
+  }
+  fclose(f);
+  return baseline;
+}
+
+static bool WriteBaseline(const std::string& path, const E2eOptions& opt, const std::vector<E2eResult>& results) {
+  FILE* f = fopen(path.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+
+  fprintf(f, "image,target_psnr,shapes_to_target,ms_to_target,final_psnr\n");
+  for (const E2eResult& r : results) {
+    fprintf(f, "%s,%.2f,%d,%.3f,%.4f\n", r.name.c_str(), opt.target, r.shapesToTarget, r.msToTarget, r.finalPsnr);
+  }
+  fclose(f);
+  return true;
+}
+
+static int ParseInit(const char* name) {
+  struct {
+    const char* name;
+    CanvasInit init;
+  } inits[] = {{"black", INIT_BLACK}, {"mean", INIT_MEAN}, {"subdivide", INIT_SUBDIVIDE}, {"superpixel", INIT_SUPERPIXEL}};
+  for (const auto& entry : inits) {
+    if (!strcmp(name, entry.name)) {
+      return entry.init;
+    }
+  }
+  fprintf(stderr, "unknown --init %s (black, mean, subdivide or superpixel)\n", name);
+  exit(2);
+}
+
+static E2eOptions ParseOptions(int argc, char** argv) {
+  E2eOptions opt;
+  for (int i = 1; i < argc; i++) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--shapes") && hasValue) {
+      opt.shapes = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--target") && hasValue) {
+      opt.target = (float)atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--threshold") && hasValue) {
+      opt.threshold = (float)atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--reps") && hasValue) {
+      opt.reps = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--threads") && hasValue) {
+      opt.threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--rect-batch") && hasValue) {
+      opt.rectBatch = std::max(0, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--cache") && hasValue) {
+      opt.cache = std::max(0, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--prune")) {
+      opt.prune = true;
+    } else if (!strcmp(argv[i], "--quadtree") && hasValue) {
+      opt.quadtree = std::max(0, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--init") && hasValue) {
+      opt.init = ParseInit(argv[++i]);
+    } else if (!strcmp(argv[i], "--seed") && hasValue) {
+      opt.seed = std::max(1ull, strtoull(argv[++i], nullptr, 10));
+    } else if (!strcmp(argv[i], "--sample") && hasValue) {
+      opt.sample = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--baseline") && hasValue) {
+      opt.baseline = argv[++i];
+    } else if (!strcmp(argv[i], "--curves") && hasValue) {
+      opt.curves = argv[++i];
+    } else if (!strcmp(argv[i], "--image") && hasValue) {
+      opt.images.push_back(argv[++i]);
+    } else if (!strcmp(argv[i], "--update-baseline")) {
+      opt.updateBaseline = true;
+    } else {
+      fprintf(stderr, "usage: %s [--shapes N] [--target DB] [--threshold F] [--reps N] [--threads N] [--seed N] [--rect-batch N] [--cache N] "
+                      "[--prune] [--quadtree N] [--init NAME] [--sample N] [--baseline PATH] [--curves PATH] [--image PATH]... [--update-baseline]\n", argv[0]);
+      exit(2);
+    }
+  }
+  return opt;
+}
+
+int main(int argc, char** argv) {
+  E2eOptions opt = ParseOptions(argc, argv);
+  SetTraceLogLevel(LOG_WARNING);
+
+  std::vector<CorpusImage> corpus = BuildCorpus(opt);
+
+  FILE* curves = fopen(opt.curves.c_str(), "w");
+  if (curves) {
+    fprintf(curves, "image,shapes,ms,mse,psnr,ssim\n");
+  }
+
+  std::vector<E2eResult> results;
+  for (const CorpusImage& img : corpus) {
+    // Curves come from the first run; the time to target is the median.
+    std::vector<E2eResult> runs;
+    for (int i = 0; i < opt.reps; i++) {
+      runs.push_back(RunImage(opt, img, i == 0 ? curves : nullptr));
+    }
+    // Runs that missed the target sort last, as if infinitely slow, so the
+    // median only misses when most runs did.
+    std::sort(runs.begin(), runs.end(), [](const E2eResult& a, const E2eResult& b) {
+      bool aMissed = a.shapesToTarget < 0;
+      bool bMissed = b.shapesToTarget < 0;
+      if (aMissed != bMissed) {
+        return bMissed;
+      }
+      return a.msToTarget < b.msToTarget;
+    });
+    results.push_back(runs[runs.size() / 2]);
+    UnloadImage(img.image);
+  }
+  if (curves) {
+    fclose(curves);
+  }
+
+  if (opt.updateBaseline) {
+    if (!WriteBaseline(opt.baseline, opt, results)) {
+      fprintf(stderr, "cannot write %s\n", opt.baseline.c_str());
+      return 2;
+    }
+    printf("baseline written to %s\n", opt.baseline.c_str());
+    return 0;
+  }
+
+  float baselineTarget = opt.target;
+  std::map<std::string, E2eResult> baseline = LoadBaseline(opt.baseline, baselineTarget);
+  // Without a baseline there is nothing to gate on, which must not pass as
+  // a clean run.
+  bool failed = baseline.empty();
+  if (baseline.empty()) {
+    fprintf(stderr, "no baseline at %s; run with --update-baseline to record one\n", opt.baseline.c_str());
+  } else if (baselineTarget != opt.target) {
+    printf("baseline target %.2f dB differs from %.2f dB; comparing anyway\n", baselineTarget, opt.target);
+  }
+
+  printf("%-12s %10s %12s %10s %12s %8s  %s\n", "image", "shapes", "ms", "base", "base ms", "change", "status");
+  for (const E2eResult& r : results) {
+    auto it = baseline.find(r.name);
+    const E2eResult* base = it != baseline.end() ? &it->second : nullptr;
+    const char* status = "new";
+    double change = 0.0;
+
+    if (base && base->shapesToTarget >= 0) {
+      if (r.shapesToTarget < 0) {
+        status = "FAIL (target not reached)";
+        failed = true;
+      } else {
+        change = r.msToTarget / base->msToTarget - 1.0;
+        status = change > opt.threshold ? "FAIL" : "ok";
+        failed |= change > opt.threshold;
+      }
+    } else if (base) {
+      status = r.shapesToTarget >= 0 ? "ok (baseline missed target)" : "ok (neither reached target)";
+    }
+
+    printf("%-12s %10d %12.1f %10d %12.1f %+7.1f%%  %s\n", r.name.c_str(), r.shapesToTarget, r.msToTarget,
+           base ? base->shapesToTarget : -1, base ? base->msToTarget : -1.0, change * 100.0, status);
+  }
+
+  return failed ? 1 : 0;
+}
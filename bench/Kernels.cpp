@@ -0,0 +1,367 @@
+// Kernel microbenchmarks: the legacy per-pixel rectangle and triangle
+// routines against the span/SAT scorers, across shape sizes, image sizes and
+// thread counts. Writes one CSV row per configuration to stdout.
+//
+//   make bench CXXFLAGS=-O2 ARGS="--quick"
+//
+// Options: --quick (fewer configurations), --reps N (timed repetitions),
+// --candidates N (shapes per repetition).
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../include/raylib.h"
+#include "../src/ImageStats.hpp"
+#include "../src/RectBatch.hpp"
+#include "../src/Rects.hpp"
+#include "../src/Shapes.hpp"
+
+struct BenchOptions {
+  bool quick = false;
+  int reps = 5;
+  int warmup = 1;
+  int candidates = 2000;
+};
+
+// What a kernel is handed per candidate: one shape, with the legacy rectangle
+// view of it for the per-pixel routines. Triangles fill a size x size box,
+// which is also what the legacy triangle loop walks.
+struct BenchCandidate {
+  Shape shape;
+  ColorRect rect;
+  long long pixels;
+};
+
+typedef double (*BenchKernel)(const ImageStats& stats, BenchCandidate& c, std::vector<Span>& spans);
+
+static double KernelBestRectColor(const ImageStats& stats, BenchCandidate& c, std::vector<Span>&) {
+  return GetBestRectColor(c.rect.rec, stats.original).r;
+}
+
+static double KernelRectangleDeltaError(const ImageStats& stats, BenchCandidate& c, std::vector<Span>&) {
+  return RectangleDeltaError(c.rect, stats.current, stats.original);
+}
+
+static double KernelRectangleError(const ImageStats& stats, BenchCandidate& c, std::vector<Span>&) {
+  return RectangleError(c.rect, stats.current);
+}
+
+// Port of triangle/main.cpp: barycentric point test per pixel of the
+// bounding box, first for the average color and then for the error of that
+// color, as the legacy triangle search scored a candidate.
+static bool PointInTriangle(Vector2 p, const Vector2* t) {
+  Vector2 v0 = {t[2].x - t[0].x, t[2].y - t[0].y};
+  Vector2 v1 = {t[1].x - t[0].x, t[1].y - t[0].y};
+  Vector2 v2 = {p.x - t[0].x, p.y - t[0].y};
+
+  float d00 = v0.x * v0.x + v0.y * v0.y;
+  float d01 = v0.x * v1.x + v0.y * v1.y;
+  float d11 = v1.x * v1.x + v1.y * v1.y;
+  float d20 = v2.x * v0.x + v2.y * v0.y;
+  float d21 = v2.x * v1.x + v2.y * v1.y;
+
+  float denom = d00 * d11 - d01 * d01;
+  if (denom == 0.0f) return false;
+
+  float v = (d11 * d20 - d01 * d21) / denom;
+  float w = (d00 * d21 - d01 * d20) / denom;
+  float u = 1.0f - v - w;
+  return u >= 0.0f && v >= 0.0f && w >= 0.0f;
+}
+
+static double KernelPointInTriangle(const ImageStats& stats, BenchCandidate& c, std::vector<Span>&) {
+  const Vector2* t = c.shape.points;
+  Image img = stats.original;
+  int minX = std::max(0, (int)std::min({t[0].x, t[1].x, t[2].x}));
+  int maxX = std::min(img.width - 1, (int)std::max({t[0].x, t[1].x, t[2].x}));
+  int minY = std::max(0, (int)std::min({t[0].y, t[1].y, t[2].y}));
+  int maxY = std::min(img.height - 1, (int)std::max({t[0].y, t[1].y, t[2].y}));
+
+  long sumR = 0, sumG = 0, sumB = 0;
+  int count = 0;
+  for (int y = minY; y <= maxY; y++) {
+    for (int x = minX; x <= maxX; x++) {
+      if (PointInTriangle(Vector2{(float)x, (float)y}, t)) {
+        Color px = GetImageColor(img, x, y);
+        sumR += px.r;
+        sumG += px.g;
+        sumB += px.b;
+        count++;
+      }
+    }
+  }
+  if (count == 0) {
+    return 0.0;
+  }
+  Color avg = {(unsigned char)(sumR / count), (unsigned char)(sumG / count), (unsigned char)(sumB / count), 255};
+
+  float error = 0.0f;
+  for (int y = minY; y <= maxY; y++) {
+    for (int x = minX; x <= maxX; x++) {
+      if (PointInTriangle(Vector2{(float)x, (float)y}, t)) {
+        Color org = GetImageColor(img, x, y);
+        float dr = float(org.r) - float(avg.r);
+        float dg = float(org.g) - float(avg.g);
+        float db = float(org.b) - float(avg.b);
+        error += dr * dr + dg * dg + db * db;
+      }
+    }
+  }
+  return error;
+}
+
+static double KernelScoreShape(const ImageStats& stats, BenchCandidate& c, std::vector<Span>& spans) {
+  return ScoreShape(c.shape, stats, spans);
+}
+
+static double KernelRasterize(const ImageStats& stats, BenchCandidate& c, std::vector<Span>& spans) {
+  RasterizeShape(c.shape, stats.width, stats.height, spans);
+  return (double)spans.size();
+}
+
+struct BenchCase {
+  const char* name;
+  ShapeType type;
+  BenchKernel kernel;
+  bool legacy;  // per-pixel routine, run on fewer candidates at large sizes
+  bool batched; // scored through RectBatch instead of kernel
+};
+
+static const BenchCase BENCH_CASES[] = {
+  {"GetBestRectColor", SHAPE_RECTANGLE, KernelBestRectColor, true, false},
+  {"RectangleDeltaError", SHAPE_RECTANGLE, KernelRectangleDeltaError, true, false},
+  {"RectangleError", SHAPE_RECTANGLE, KernelRectangleError, true, false},
+  {"ScoreRectangle", SHAPE_RECTANGLE, KernelScoreShape, false, false},
+  {"ScoreRectBatch", SHAPE_RECTANGLE, nullptr, false, true},
+  {"ScoreGradientRectangle", SHAPE_GRADIENT_RECTANGLE, KernelScoreShape, false, false},
+  {"PointInTriangle", SHAPE_TRIANGLE, KernelPointInTriangle, true, false},
+  {"ScoreTriangle", SHAPE_TRIANGLE, KernelScoreShape, false, false},
+  {"ScoreEllipse", SHAPE_ELLIPSE, KernelScoreShape, false, false},
+  {"ScoreRotatedRectangle", SHAPE_ROTATED_RECTANGLE, KernelScoreShape, false, false},
+  {"ScoreSplat", SHAPE_SPLAT, KernelScoreShape, false, false},
+  {"RasterizeTriangle", SHAPE_TRIANGLE, KernelRasterize, false, false},
+  {"RasterizeEllipse", SHAPE_ELLIPSE, KernelRasterize, false, false},
+};
+
+// Smooth gradients with noise on top, so colors and errors are not trivial.
+static Image MakeBenchImage(int w, int h, unsigned seed) {
+  Image img = GenImageColor(w, h, BLACK);
+  ImageFormat(&img, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  Color* px = (Color*)img.data;
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> noise(-24, 24);
+
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      int r = 255 * x / w + noise(rng);
+      int g = 255 * y / h + noise(rng);
+      int b = 128 + noise(rng);
+      px[y * w + x] = Color{(unsigned char)std::clamp(r, 0, 255), (unsigned char)std::clamp(g, 0, 255),
+                            (unsigned char)std::clamp(b, 0, 255), 255};
+    }
+  }
+  return img;
+}
+
+// Shapes of roughly size x size pixels at random positions inside the image.
+static std::vector<BenchCandidate> MakeCandidates(ShapeType type, int size, int count, int w, int h, unsigned seed) {
+  std::mt19937 rng(seed);
+  size = std::min(size, std::min(w, h));
+  std::uniform_int_distribution<int> px(0, w - size);
+  std::uniform_int_distribution<int> py(0, h - size);
+  std::uniform_real_distribution<float> angle(0.0f, 3.14159265f);
+  std::uniform_int_distribution<int> channel(0, 255);
+
+  std::vector<BenchCandidate> out(count);
+  for (BenchCandidate& c : out) {
+    Shape& s = c.shape;
+    s = Shape{};
+    s.type = type;
+    s.c = Color{(unsigned char)channel(rng), (unsigned char)channel(rng), (unsigned char)channel(rng), 255};
+    float x = (float)px(rng);
+    float y = (float)py(rng);
+    float half = size * 0.5f;
+
+    switch (type) {
+      case SHAPE_ELLIPSE:
+      case SHAPE_ROTATED_RECTANGLE:
+        s.x = x + half;
+        s.y = y + half;
+        s.width = std::max(half, 0.5f);
+        s.height = std::max(half * 0.5f, 0.5f);
+        s.angle = angle(rng);
+        break;
+      case SHAPE_SPLAT:
+        s.x = x + half;
+        s.y = y + half;
+        s.width = std::max(half / 3.0f, 0.5f);
+        s.height = std::max(half / 6.0f, 0.5f);
+        s.angle = angle(rng);
+        s.c.a = 192;
+        break;
+      case SHAPE_TRIANGLE:
+        s.pointCount = 3;
+        s.points[0] = Vector2{x, y};
+        s.points[1] = Vector2{x, y + size - 1};
+        s.points[2] = Vector2{x + size - 1, y + half};
+        break;
+      default:
+        s.x = x;
+        s.y = y;
+        s.width = (float)size;
+        s.height = (float)size;
+        break;
+    }
+
+    c.rect = ColorRect{Rectangle{x, y, (float)size, (float)size}, s.c};
+
+    std::vector<Span> spans;
+    RasterizeShape(s, w, h, spans);
+    c.pixels = 0;
+    for (const Span& sp : spans) {
+      c.pixels += sp.x1 - sp.x0;
+    }
+  }
+  return out;
+}
+
+static double RunBatch(const BenchCase& bc, const ImageStats& stats, std::vector<BenchCandidate>& candidates, int threads) {
+  std::vector<double> sinks(threads, 0.0);
+  RectBatch batch;
+  if (bc.batched) {
+    batch.count = (int)candidates.size();
+    for (const BenchCandidate& c : candidates) {
+      batch.x0.push_back((int)c.shape.x);
+      batch.y0.push_back((int)c.shape.y);
+      batch.x1.push_back((int)(c.shape.x + c.shape.width));
+      batch.y1.push_back((int)(c.shape.y + c.shape.height));
+    }
+    batch.gain.resize(batch.count);
+    batch.color.resize(batch.count);
+  }
+
+  auto work = [&](int tid) {
+    if (bc.batched) {
+      int begin = batch.count * tid / threads;
+      int end = batch.count * (tid + 1) / threads;
+      ScoreRectBatch(batch, stats, begin, end);
+      sinks[tid] = end > begin ? batch.gain[begin] : 0.0;
+      return;
+    }
+
+    std::vector<Span> spans;
+    double sink = 0.0;
+    for (size_t i = tid; i < candidates.size(); i += threads) {
+      sink += bc.kernel(stats, candidates[i], spans);
+    }
+    sinks[tid] = sink;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  if (threads == 1) {
+    work(0);
+  } else {
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) {
+      pool.emplace_back(work, t);
+    }
+    for (auto& t : pool) {
+      t.join();
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  // Keep the results observable so the calls are not optimized out.
+  volatile double keep = 0.0;
+  for (double s : sinks) keep = keep + s;
+  (void)keep;
+
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+static BenchOptions ParseOptions(int argc, char** argv) {
+  BenchOptions opt;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--quick")) {
+      opt.quick = true;
+    } else if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+      opt.reps = std::max(1, atoi(argv[++i]));
+    } else if (!strcmp(argv[i], "--candidates") && i + 1 < argc) {
+      opt.candidates = std::max(1, atoi(argv[++i]));
+    } else {
+      fprintf(stderr, "usage: %s [--quick] [--reps N] [--candidates N]\n", argv[0]);
+      exit(1);
+    }
+  }
+  return opt;
+}
+
+int main(int argc, char** argv) {
+  BenchOptions opt = ParseOptions(argc, argv);
+  SetTraceLogLevel(LOG_WARNING);
+
+  std::vector<int> sizes = {1, 4, 16, 64, 128, 256, 400};
+  std::vector<std::pair<int, int>> images = {{256, 256}, {640, 480}, {1280, 720}};
+  int hw = std::max(1, (int)std::thread::hardware_concurrency());
+  std::vector<int> threadCounts = {1, 2, 4, hw};
+  if (opt.quick) {
+    sizes = {4, 64, 256};
+    images = {{640, 480}};
+    threadCounts = {1, hw};
+  }
+  std::sort(threadCounts.begin(), threadCounts.end());
+  threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+  printf("kernel,image_w,image_h,size,threads,candidates,reps,ns_per_candidate,ns_per_pixel,candidates_per_sec\n");
+
+  for (auto [w, h] : images) {
+    Image original = MakeBenchImage(w, h, 1);
+    Image current = MakeBenchImage(w, h, 2);
+    ImageStats stats = BuildImageStats(original, current);
+    BuildCanvasSat(stats);
+
+    for (const BenchCase& bc : BENCH_CASES) {
+      for (int size : sizes) {
+        if (size > std::min(w, h)) {
+          continue;
+        }
+        // The per-pixel routines are too slow for a full sweep at large sizes.
+        int count = bc.legacy && size >= 256 ? std::max(1, opt.candidates / 20) : opt.candidates;
+        std::vector<BenchCandidate> candidates = MakeCandidates(bc.type, size, count, w, h, 3);
+        long long pixels = 0;
+        for (const BenchCandidate& c : candidates) {
+          pixels += bc.legacy ? (long long)(c.rect.rec.width * c.rect.rec.height) : c.pixels;
+        }
+
+        for (int threads : threadCounts) {
+          for (int i = 0; i < opt.warmup; i++) {
+            RunBatch(bc, stats, candidates, threads);
+          }
+
+          std::vector<double> times;
+          for (int i = 0; i < opt.reps; i++) {
+            times.push_back(RunBatch(bc, stats, candidates, threads));
+          }
+          std::sort(times.begin(), times.end());
+          double ns = times[times.size() / 2]; // median repetition
+
+          printf("%s,%d,%d,%d,%d,%d,%d,%.2f,%.4f,%.0f\n", bc.name, w, h, size, threads, count, opt.reps,
+                 ns / count, pixels > 0 ? ns / pixels : 0.0, count / (ns * 1e-9));
+          fflush(stdout);
+        }
+      }
+    }
+
+    UnloadImage(original);
+    UnloadImage(current);
+  }
+
+  return 0;
+}
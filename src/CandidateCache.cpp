@@ -0,0 +1,155 @@
+#include "CandidateCache.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+static bool Intersects(SpanBox a, SpanBox b) {
+  return a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 && b.y0 < a.y1;
+}
+
+// Grid cells [cx0, cx1] x [cy0, cy1] covered by the box.
+static void CellRange(const CandidateCache& cache, SpanBox box, int& cx0, int& cy0, int& cx1, int& cy1) {
+  cx0 = std::clamp(box.x0 / CANDIDATE_CELL_SIZE, 0, cache.cols - 1);
+  cy0 = std::clamp(box.y0 / CANDIDATE_CELL_SIZE, 0, cache.rows - 1);
+  cx1 = std::clamp((box.x1 - 1) / CANDIDATE_CELL_SIZE, 0, cache.cols - 1);
+  cy1 = std::clamp((box.y1 - 1) / CANDIDATE_CELL_SIZE, 0, cache.rows - 1);
+}
+
+static void Unlink(CandidateCache& cache, int slot) {
+  CachedCandidate& c = cache.slots[slot];
+  int cx0, cy0, cx1, cy1;
+  CellRange(cache, c.box, cx0, cy0, cx1, cy1);
+  for (int cy = cy0; cy <= cy1; cy++) {
+    for (int cx = cx0; cx <= cx1; cx++) {
+      std::vector<int>& cell = cache.cells[cy * cache.cols + cx];
+      cell.erase(std::find(cell.begin(), cell.end(), slot));
+    }
+  }
+}
+
+static void Evict(CandidateCache& cache, int slot) {
+  CachedCandidate& c = cache.slots[slot];
+  cache.ranking.erase({c.gain, slot});
+  Unlink(cache, slot);
+  c.alive = false;
+  cache.freeSlots.push_back(slot);
+}
+
+CandidateCache CreateCandidateCache(int capacity, int width, int height) {
+  CandidateCache cache;
+  cache.capacity = capacity;
+  cache.width = width;
+  cache.height = height;
+  cache.cols = std::max(1, (width + CANDIDATE_CELL_SIZE - 1) / CANDIDATE_CELL_SIZE);
+  cache.rows = std::max(1, (height + CANDIDATE_CELL_SIZE - 1) / CANDIDATE_CELL_SIZE);
+  cache.cells.resize(cache.cols * cache.rows);
+
+  cache.slots.resize(capacity);
+  for (int i = capacity - 1; i >= 0; i--) {
+    cache.freeSlots.push_back(i);
+  }
+  return cache;
+}
+
+void OfferCandidate(CandidateCache& cache, const Shape& shape, float gain, SpanBox box) {
+  if (gain <= 0.0f || box.x1 <= box.x0 || cache.capacity == 0) {
+    return;
+  }
+  if (cache.freeSlots.empty()) {
+    auto worst = cache.ranking.begin();
+    if (worst->first >= gain) {
+      return;
+    }
+    Evict(cache, worst->second);
+  }
+
+  int slot = cache.freeSlots.back();
+  cache.freeSlots.pop_back();
+
+  CachedCandidate& c = cache.slots[slot];
+  c.shape = shape;
+  c.gain = gain;
+  c.box = box;
+  c.alive = true;
+  c.stale = false;
+  cache.ranking.insert({gain, slot});
+
+  int cx0, cy0, cx1, cy1;
+  CellRange(cache, box, cx0, cy0, cx1, cy1);
+  for (int cy = cy0; cy <= cy1; cy++) {
+    for (int cx = cx0; cx <= cx1; cx++) {
+      cache.cells[cy * cache.cols + cx].push_back(slot);
+    }
+  }
+}
+
+float RefreshBestCandidate(CandidateCache& cache, const ImageStats& stats) {
+  std::vector<Span> spans;
+  while (!cache.ranking.empty()) {
+    auto top = std::prev(cache.ranking.end());
+    int slot = top->second;
+    CachedCandidate& c = cache.slots[slot];
+    if (!c.stale) {
+      return top->first;
+    }
+
+    // Same shape, same spans and box; only its color and gain move.
+    cache.ranking.erase(top);
+    c.gain = ScoreShape(c.shape, stats, spans);
+    c.stale = false;
+    if (c.gain > 0.0f) {
+      cache.ranking.insert({c.gain, slot});
+    } else {
+      Unlink(cache, slot);
+      c.alive = false;
+      cache.freeSlots.push_back(slot);
+    }
+  }
+  return -1e30f;
+}
+
+bool TakeBestCandidate(CandidateCache& cache, Shape& shape, float& gain) {
+  if (cache.ranking.empty()) {
+    return false;
+  }
+
+  int slot = cache.ranking.rbegin()->second;
+  shape = cache.slots[slot].shape;
+  gain = cache.slots[slot].gain;
+  Evict(cache, slot);
+  return true;
+}
+
+int InvalidateCandidates(CandidateCache& cache, SpanBox dirty) {
+  if (dirty.x1 <= dirty.x0) {
+    return 0;
+  }
+
+  int marked = 0;
+  int cx0, cy0, cx1, cy1;
+  CellRange(cache, dirty, cx0, cy0, cx1, cy1);
+  for (int cy = cy0; cy <= cy1; cy++) {
+    for (int cx = cx0; cx <= cx1; cx++) {
+      for (int slot : cache.cells[cy * cache.cols + cx]) {
+        CachedCandidate& c = cache.slots[slot];
+        if (!c.stale && Intersects(c.box, dirty)) {
+          c.stale = true;
+          marked++;
+        }
+      }
+    }
+  }
+
+  return marked;
+}
+
+float CandidateCacheFloor(const CandidateCache& cache) {
+  if (cache.freeSlots.empty() && !cache.ranking.empty()) {
+    return cache.ranking.begin()->first;
+  }
+  return 0.0f;
+}
+
+int CachedCandidateCount(const CandidateCache& cache) {
+  return (int)cache.ranking.size();
+}
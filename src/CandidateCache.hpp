@@ -0,0 +1,66 @@
+#pragma once
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "ImageStats.hpp"
+#include "Shapes.hpp"
+
+// Side of the uniform grid cells the cache indexes candidates by.
+constexpr int CANDIDATE_CELL_SIZE = 32;
+
+// A shape's gain depends only on the pixels under it, so a scored candidate
+// stays exact until a commit overlaps it. The cache keeps the best scored
+// candidates across iterations, ranked by gain, with a uniform grid over
+// their bounding boxes so a commit only has to look at the ones it touched.
+// Those are marked stale and re-scored lazily, once they reach the top of the
+// ranking; most of them get pushed out by fresher candidates first.
+struct CachedCandidate {
+  Shape shape;
+  float gain = 0.0f;
+  SpanBox box;
+  bool alive = false;
+  bool stale = false;
+};
+
+struct CandidateCache {
+  int capacity = 0;
+  int width = 0;
+  int height = 0;
+  int cols = 0;
+  int rows = 0;
+
+  std::vector<CachedCandidate> slots;
+  std::vector<int> freeSlots;
+  std::vector<std::vector<int>> cells;
+
+  // (gain, slot): the back is the best candidate, the front the eviction
+  // victim.
+  std::set<std::pair<float, int>> ranking;
+};
+
+CandidateCache CreateCandidateCache(int capacity, int width, int height);
+
+// Keeps the candidate if it has a positive gain and the cache has room or
+// holds a worse one, which it then evicts. box is the candidate's span box.
+void OfferCandidate(CandidateCache& cache, const Shape& shape, float gain, SpanBox box);
+
+// Re-scores stale candidates from the top of the ranking down until the best
+// one is current, evicting those left without a positive gain. Returns the
+// best gain, -1e30 when the cache is empty.
+float RefreshBestCandidate(CandidateCache& cache, const ImageStats& stats);
+
+// Removes and returns the best candidate; false when the cache is empty.
+// Call RefreshBestCandidate first for an up-to-date one.
+bool TakeBestCandidate(CandidateCache& cache, Shape& shape, float& gain);
+
+// Marks every cached candidate whose box intersects dirty as stale. Returns
+// how many were marked.
+int InvalidateCandidates(CandidateCache& cache, SpanBox dirty);
+
+// Gain an offer has to beat to get in: the worst cached gain when the cache
+// is full, 0 otherwise.
+float CandidateCacheFloor(const CandidateCache& cache);
+
+int CachedCandidateCount(const CandidateCache& cache);
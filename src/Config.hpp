@@ -0,0 +1,17 @@
+#pragma once
+
+constexpr int NUM_RECTS_PER_ITERATION = 200;
+constexpr int MAX_ITERATIONS = 20000;
+constexpr int NUM_MUTATIONS_PER_ITERATION = 50;
+
+constexpr int MAX_START_SIZE = 200;
+constexpr int MIN_END_SIZE = 1;
+
+// Translucent levels tried for every candidate on top of the opaque fit.
+constexpr bool BLEND_SHAPES = true;
+constexpr unsigned char ALPHA_LEVELS[] = {192, 128, 64};
+
+constexpr float SCALE = 0.333;
+
+constexpr int SCREENWIDTH = 1366;
+constexpr int SCREENHEIGHT = 768;
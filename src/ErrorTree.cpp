@@ -0,0 +1,114 @@
+#include "ErrorTree.hpp"
+
+#include <algorithm>
+
+#include "Random.hpp"
+
+// Side in pixels of the nodes on level l.
+static int NodeSize(const ErrorQuadtree& tree, int l) {
+  return ERROR_BLOCK_SIZE << (tree.depth - l);
+}
+
+// Re-sums the nodes of levels depth - 1 .. 0 above leaves [x0, x1) x [y0, y1).
+static void SumUp(ErrorQuadtree& tree, int x0, int y0, int x1, int y1) {
+  for (int l = tree.depth - 1; l >= 0; l--) {
+    x0 >>= 1;
+    y0 >>= 1;
+    x1 = (x1 + 1) >> 1;
+    y1 = (y1 + 1) >> 1;
+
+    int side = 1 << l;
+    const std::vector<long long>& below = tree.levels[l + 1];
+    std::vector<long long>& here = tree.levels[l];
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+        int c = (2 * y) * (2 * side) + 2 * x;
+        here[y * side + x] = below[c] + below[c + 1] + below[c + 2 * side] + below[c + 2 * side + 1];
+      }
+    }
+  }
+}
+
+static void CopyLeaves(ErrorQuadtree& tree, const ImageStats& stats, int x0, int y0, int x1, int y1) {
+  int side = 1 << tree.depth;
+  std::vector<long long>& leaves = tree.levels[tree.depth];
+  for (int y = y0; y < y1; y++) {
+    for (int x = x0; x < x1; x++) {
+      leaves[y * side + x] = stats.blockErr[y * stats.blockCols + x];
+    }
+  }
+}
+
+ErrorQuadtree BuildErrorQuadtree(const ImageStats& stats) {
+  ErrorQuadtree tree;
+  tree.width = stats.width;
+  tree.height = stats.height;
+  while ((1 << tree.depth) < std::max(stats.blockCols, stats.blockRows)) {
+    tree.depth++;
+  }
+
+  tree.levels.resize(tree.depth + 1);
+  for (int l = 0; l <= tree.depth; l++) {
+    tree.levels[l].assign((size_t)1 << (2 * l), 0);
+  }
+
+  CopyLeaves(tree, stats, 0, 0, stats.blockCols, stats.blockRows);
+  SumUp(tree, 0, 0, stats.blockCols, stats.blockRows);
+  return tree;
+}
+
+void UpdateErrorQuadtree(ErrorQuadtree& tree, const ImageStats& stats, SpanBox dirty) {
+  if (dirty.x1 <= dirty.x0 || dirty.y1 <= dirty.y0) {
+    return;
+  }
+
+  int x0 = dirty.x0 / ERROR_BLOCK_SIZE;
+  int y0 = dirty.y0 / ERROR_BLOCK_SIZE;
+  int x1 = (dirty.x1 + ERROR_BLOCK_SIZE - 1) / ERROR_BLOCK_SIZE;
+  int y1 = (dirty.y1 + ERROR_BLOCK_SIZE - 1) / ERROR_BLOCK_SIZE;
+  CopyLeaves(tree, stats, x0, y0, x1, y1);
+  SumUp(tree, x0, y0, x1, y1);
+}
+
+bool SampleErrorQuadtree(const ErrorQuadtree& tree, int maxSize, int& x, int& y, int& size) {
+  if (tree.levels.empty() || tree.levels[0][0] <= 0) {
+    return false;
+  }
+
+  int scale = 0;
+  while (scale < tree.depth && NodeSize(tree, scale) > maxSize) {
+    scale++;
+  }
+  while (scale < tree.depth && RandInt(0, 1) == 1) {
+    scale++;
+  }
+  size = std::min(NodeSize(tree, scale), maxSize);
+
+  int nx = 0;
+  int ny = 0;
+  for (int l = 0; l < tree.depth; l++) {
+    int side = 2 << l;
+    const std::vector<long long>& below = tree.levels[l + 1];
+    long long pick = RandLong(0, tree.levels[l][(ny << l) + nx] - 1);
+
+    int cx = 2 * nx;
+    int cy = 2 * ny;
+    for (int child = 0; child < 4; child++) {
+      int ix = cx + (child & 1);
+      int iy = cy + (child >> 1);
+      long long e = below[iy * side + ix];
+      if (pick < e || child == 3) {
+        nx = ix;
+        ny = iy;
+        break;
+      }
+      pick -= e;
+    }
+  }
+
+  int bx = nx * ERROR_BLOCK_SIZE;
+  int by = ny * ERROR_BLOCK_SIZE;
+  x = bx + RandInt(0, std::min(ERROR_BLOCK_SIZE, tree.width - bx) - 1);
+  y = by + RandInt(0, std::min(ERROR_BLOCK_SIZE, tree.height - by) - 1);
+  return true;
+}
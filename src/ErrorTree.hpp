@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "ImageStats.hpp"
+
+// Quadtree over the ERROR_BLOCK_SIZE error blocks of ImageStats. Every node
+// holds the current error under it; level 0 is the root and level depth the
+// blocks themselves, padded out to a power of two with empty nodes. Walking
+// down in proportion to error finds bad regions in one step per level, and a
+// commit only touches the paths above the blocks it changed.
+struct ErrorQuadtree {
+  int width = 0;
+  int height = 0;
+  int depth = 0;
+  std::vector<std::vector<long long>> levels; // level l is (1 << l) nodes square, row-major
+};
+
+// Needs BuildErrorBlocks on the stats.
+ErrorQuadtree BuildErrorQuadtree(const ImageStats& stats);
+
+// Copies the blocks under dirty from the stats (after UpdateImageStats) and
+// re-sums their ancestors.
+void UpdateErrorQuadtree(ErrorQuadtree& tree, const ImageStats& stats, SpanBox dirty);
+
+// Picks a pixel with probability proportional to the error of its block, and
+// a size from the scale of the nodes on the way down: the first level no
+// wider than maxSize, then one level smaller at a time with probability 1/2.
+// Returns false when no error is left.
+bool SampleErrorQuadtree(const ErrorQuadtree& tree, int maxSize, int& x, int& y, int& size);
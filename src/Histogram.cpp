@@ -0,0 +1,197 @@
+#include "Histogram.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "ImageStats.hpp"
+
+static int Bin(unsigned char v) {
+  return v / HISTOGRAM_BIN_WIDTH;
+}
+
+IntegralHistogram BuildIntegralHistogram(Image original) {
+  IntegralHistogram hist;
+  hist.width = original.width;
+  hist.height = original.height;
+
+  int stride = hist.width + 1;
+  int tilesX = hist.width / HISTOGRAM_TILE + 1;
+  int tilesY = hist.height / HISTOGRAM_TILE + 1;
+
+  hist.cols.assign((size_t)tilesX * (hist.height + 1) * HISTOGRAM_PLANES, 0);
+  hist.rows.assign((size_t)tilesY * stride * HISTOGRAM_PLANES, 0);
+  hist.deltas.assign((size_t)(hist.height + 1) * stride * HISTOGRAM_PLANES, 0);
+
+  // Full integral of the current grid row; the previous row is the same
+  // vector before the running row sums are added in.
+  std::vector<unsigned int> line((size_t)stride * HISTOGRAM_PLANES, 0);
+  std::vector<unsigned int> rowSums(HISTOGRAM_PLANES);
+  const Color* org = Pixels(original);
+
+  for (int y = 0; y <= hist.height; y++) {
+    if (y > 0) {
+      std::fill(rowSums.begin(), rowSums.end(), 0);
+      for (int x = 1; x <= hist.width; x++) {
+        Color px = org[(y - 1) * hist.width + x - 1];
+        rowSums[Bin(px.r)]++;
+        rowSums[HISTOGRAM_BINS + Bin(px.g)]++;
+        rowSums[2 * HISTOGRAM_BINS + Bin(px.b)]++;
+
+        unsigned int* h = &line[(size_t)x * HISTOGRAM_PLANES];
+        for (int p = 0; p < HISTOGRAM_PLANES; p++) {
+          h[p] += rowSums[p];
+        }
+      }
+    }
+
+    int ty = y / HISTOGRAM_TILE;
+    if (y % HISTOGRAM_TILE == 0) {
+      std::copy(line.begin(), line.end(), hist.rows.begin() + (size_t)ty * stride * HISTOGRAM_PLANES);
+    }
+    const unsigned int* tileRow = &hist.rows[(size_t)ty * stride * HISTOGRAM_PLANES];
+
+    for (int x = 0; x <= hist.width; x++) {
+      int tx = x / HISTOGRAM_TILE;
+      int X = tx * HISTOGRAM_TILE;
+      const unsigned int* h = &line[(size_t)x * HISTOGRAM_PLANES];
+
+      if (x == X) {
+        std::copy(h, h + HISTOGRAM_PLANES, &hist.cols[((size_t)tx * (hist.height + 1) + y) * HISTOGRAM_PLANES]);
+      }
+
+      const unsigned int* hX = &line[(size_t)X * HISTOGRAM_PLANES];
+      const unsigned int* hY = &tileRow[(size_t)x * HISTOGRAM_PLANES];
+      const unsigned int* hXY = &tileRow[(size_t)X * HISTOGRAM_PLANES];
+      unsigned short* d = &hist.deltas[((size_t)y * stride + x) * HISTOGRAM_PLANES];
+      for (int p = 0; p < HISTOGRAM_PLANES; p++) {
+        d[p] = (unsigned short)(h[p] - hX[p] - hY[p] + hXY[p]);
+      }
+    }
+  }
+
+  return hist;
+}
+
+// Adds sign * H(x, y) into counts.
+static void AccumulateIntegral(const IntegralHistogram& hist, int x, int y, int sign, int* counts) {
+  int stride = hist.width + 1;
+  int tx = x / HISTOGRAM_TILE;
+  int ty = y / HISTOGRAM_TILE;
+
+  const unsigned int* col = &hist.cols[((size_t)tx * (hist.height + 1) + y) * HISTOGRAM_PLANES];
+  const unsigned int* row = &hist.rows[((size_t)ty * stride + x) * HISTOGRAM_PLANES];
+  const unsigned int* corner = &hist.rows[((size_t)ty * stride + tx * HISTOGRAM_TILE) * HISTOGRAM_PLANES];
+  const unsigned short* d = &hist.deltas[((size_t)y * stride + x) * HISTOGRAM_PLANES];
+
+  for (int p = 0; p < HISTOGRAM_PLANES; p++) {
+    counts[p] += sign * (int)(col[p] + row[p] - corner[p] + d[p]);
+  }
+}
+
+void GetRectHistogram(const IntegralHistogram& hist, int x0, int y0, int x1, int y1, int* counts) {
+  std::fill(counts, counts + HISTOGRAM_PLANES, 0);
+  AccumulateIntegral(hist, x1, y1, 1, counts);
+  AccumulateIntegral(hist, x0, y1, -1, counts);
+  AccumulateIntegral(hist, x1, y0, -1, counts);
+  AccumulateIntegral(hist, x0, y0, 1, counts);
+}
+
+// Bin holding the median and how many of its pixels sit below the median.
+static int MedianBin(const int* bins, int n, int& below) {
+  int half = (n + 1) / 2;
+  int cumulative = 0;
+  for (int b = 0; b < HISTOGRAM_BINS; b++) {
+    if (cumulative + bins[b] >= half) {
+      below = half - cumulative;
+      return b;
+    }
+    cumulative += bins[b];
+  }
+  below = 0;
+  return HISTOGRAM_BINS - 1;
+}
+
+Color GetHistogramMedianColor(const int* counts, int n) {
+  if (n == 0) {
+    return Color{0, 0, 0, 255};
+  }
+
+  unsigned char out[3];
+  for (int ch = 0; ch < 3; ch++) {
+    const int* bins = counts + ch * HISTOGRAM_BINS;
+    int below = 0;
+    int b = MedianBin(bins, n, below);
+    float v = b * HISTOGRAM_BIN_WIDTH + HISTOGRAM_BIN_WIDTH * (below - 0.5f) / std::max(bins[b], 1);
+    out[ch] = (unsigned char)std::clamp((int)(v + 0.5f), 0, 255);
+  }
+
+  return Color{out[0], out[1], out[2], 255};
+}
+
+// sum(|c - v|) over every value v the bin covers.
+static long long BinDistanceSum(int c, int bin) {
+  const int w = HISTOGRAM_BIN_WIDTH;
+  int lo = bin * w;
+  int hi = lo + w - 1;
+  if (c <= lo) {
+    return (long long)w * (lo - c) + w * (w - 1) / 2;
+  }
+  if (c >= hi) {
+    return (long long)w * (c - hi) + w * (w - 1) / 2;
+  }
+  int below = c - lo;
+  int above = hi - c;
+  return below * (below + 1) / 2 + above * (above + 1) / 2;
+}
+
+long long HistogramL1Error(const int* counts, Color c) {
+  int value[3] = {c.r, c.g, c.b};
+  long long e = 0;
+
+  for (int ch = 0; ch < 3; ch++) {
+    for (int b = 0; b < HISTOGRAM_BINS; b++) {
+      e += (long long)counts[ch * HISTOGRAM_BINS + b] * BinDistanceSum(value[ch], b);
+    }
+  }
+
+  return (e + HISTOGRAM_BIN_WIDTH / 2) / HISTOGRAM_BIN_WIDTH;
+}
+
+Color RefineMedianColor(const IntegralHistogram& hist, Rectangle rec, Image original) {
+  int x0 = rec.x;
+  int y0 = rec.y;
+  int x1 = std::min((int)(rec.x + rec.width), hist.width);
+  int y1 = std::min((int)(rec.y + rec.height), hist.height);
+  int n = (x1 - x0) * (y1 - y0);
+  if (n <= 0) {
+    return Color{0, 0, 0, 255};
+  }
+
+  int counts[HISTOGRAM_PLANES];
+  GetRectHistogram(hist, x0, y0, x1, y1, counts);
+
+  const Color* org = Pixels(original);
+  std::vector<unsigned char> values;
+  unsigned char out[3];
+
+  for (int ch = 0; ch < 3; ch++) {
+    int below = 0;
+    int b = MedianBin(counts + ch * HISTOGRAM_BINS, n, below);
+
+    values.clear();
+    for (int y = y0; y < y1; y++) {
+      for (int x = x0; x < x1; x++) {
+        Color px = org[y * hist.width + x];
+        unsigned char v = ch == 0 ? px.r : ch == 1 ? px.g : px.b;
+        if (Bin(v) == b) {
+          values.push_back(v);
+        }
+      }
+    }
+
+    std::nth_element(values.begin(), values.begin() + (below - 1), values.end());
+    out[ch] = values[below - 1];
+  }
+
+  return Color{out[0], out[1], out[2], 255};
+}
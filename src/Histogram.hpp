@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "../include/raylib.h"
+
+constexpr int HISTOGRAM_BINS = 16;
+constexpr int HISTOGRAM_BIN_WIDTH = 256 / HISTOGRAM_BINS;
+constexpr int HISTOGRAM_PLANES = 3 * HISTOGRAM_BINS;
+
+// Largest tile whose local counts, (TILE - 1)^2, still fit in 16 bits.
+constexpr int HISTOGRAM_TILE = 256;
+
+// Per-channel integral histograms of the original, stored compactly: full
+// 32-bit integrals only along tile boundaries, and 16-bit counts of the local
+// rectangle [X, x) x [Y, y) back to the enclosing tile corner (X, Y) elsewhere.
+// All HISTOGRAM_PLANES bins of a grid point sit next to each other.
+struct IntegralHistogram {
+  int width = 0;  // image size; the integral grid is (width + 1) x (height + 1)
+  int height = 0;
+
+  std::vector<unsigned int> cols;     // [x / TILE][y][plane] = H(X, y)
+  std::vector<unsigned int> rows;     // [y / TILE][x][plane] = H(x, Y)
+  std::vector<unsigned short> deltas; // [y][x][plane]
+};
+
+IntegralHistogram BuildIntegralHistogram(Image original);
+
+// Bin counts of the rectangle [x0, x1) x [y0, y1), HISTOGRAM_PLANES entries.
+void GetRectHistogram(const IntegralHistogram& hist, int x0, int y0, int x1, int y1, int* counts);
+
+// Per-channel median from the bins, interpolated inside the median bin.
+Color GetHistogramMedianColor(const int* counts, int n);
+
+// sum(|c - org|) over the pixels counted, expected with the values spread
+// evenly over each bin; unbiased under that assumption, also in the bin
+// that holds c.
+long long HistogramL1Error(const int* counts, Color c);
+
+// Exact median of the rectangle: only pixels inside each channel's coarse
+// median bin are visited. Meant for the one shape committed per iteration.
+Color RefineMedianColor(const IntegralHistogram& hist, Rectangle rec, Image original);
@@ -0,0 +1,389 @@
+#include "ImageStats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+
+#include "Config.hpp"
+#include "WeightMap.hpp"
+
+static long long PixelError(Color cur, Color org) {
+  return (cur.r - org.r) * (cur.r - org.r) +
+         (cur.g - org.g) * (cur.g - org.g) +
+         (cur.b - org.b) * (cur.b - org.b);
+}
+
+int PixelWeight(const ImageStats& stats, int x, int y) {
+  return stats.weights ? stats.weights->w[y * stats.width + x] : 1;
+}
+
+static void BuildCanvasRow(ImageStats& stats, const Color* cur, const Color* org, int y, int from) {
+  int row = y * (stats.width + 1);
+  const Color* c = cur + y * stats.width;
+  const Color* o = org + y * stats.width;
+
+  for (int x = from; x < stats.width; x++) {
+    Color px = c[x];
+    int i = row + x;
+    int w = PixelWeight(stats, x, y);
+    stats.cr[i + 1] = stats.cr[i] + w * px.r;
+    stats.cg[i + 1] = stats.cg[i] + w * px.g;
+    stats.cb[i + 1] = stats.cb[i] + w * px.b;
+    stats.csq[i + 1] = stats.csq[i] + w * (px.r * px.r + px.g * px.g + px.b * px.b);
+    stats.cross[i + 1] = stats.cross[i] + w * (px.r * o[x].r + px.g * o[x].g + px.b * o[x].b);
+    stats.err[i + 1] = stats.err[i] + w * PixelError(px, o[x]);
+    stats.errL1[i + 1] = stats.errL1[i] + std::abs(px.r - o[x].r) + std::abs(px.g - o[x].g) + std::abs(px.b - o[x].b);
+  }
+}
+
+ImageStats BuildImageStats(Image original, Image current, const WeightMap* weights) {
+  ImageStats stats;
+  stats.width = original.width;
+  stats.height = original.height;
+  stats.original = original;
+  stats.current = current;
+  stats.weights = weights;
+
+  int stride = stats.width + 1;
+  size_t size = (size_t)stride * stats.height;
+  stats.r.assign(size, 0);
+  stats.g.assign(size, 0);
+  stats.b.assign(size, 0);
+  stats.sq.assign(size, 0);
+  stats.n.assign(size, 0);
+  stats.cr.assign(size, 0);
+  stats.cg.assign(size, 0);
+  stats.cb.assign(size, 0);
+  stats.csq.assign(size, 0);
+  stats.cross.assign(size, 0);
+  stats.err.assign(size, 0);
+  stats.errL1.assign(size, 0);
+
+  const Color* org = Pixels(original);
+  const Color* cur = Pixels(current);
+
+  size_t satSize = (size_t)stride * (stats.height + 1);
+  for (std::vector<long long>& plane : stats.sat) {
+    plane.assign(satSize, 0);
+  }
+
+  for (int y = 0; y < stats.height; y++) {
+    int row = y * stride;
+    for (int x = 0; x < stats.width; x++) {
+      Color px = org[y * stats.width + x];
+      int w = PixelWeight(stats, x, y);
+      stats.r[row + x + 1] = stats.r[row + x] + w * px.r;
+      stats.g[row + x + 1] = stats.g[row + x] + w * px.g;
+      stats.b[row + x + 1] = stats.b[row + x] + w * px.b;
+      stats.sq[row + x + 1] = stats.sq[row + x] + w * (px.r * px.r + px.g * px.g + px.b * px.b);
+      stats.n[row + x + 1] = stats.n[row + x] + w;
+    }
+    BuildCanvasRow(stats, cur, org, y, 0);
+
+    long long rowSums[SAT_PLANES] = {};
+    for (int x = 0; x < stats.width; x++) {
+      Color px = org[y * stats.width + x];
+      long long w = PixelWeight(stats, x, y);
+      long long wx = w * x;
+      long long wy = w * y;
+      long long values[SAT_PLANES] = {
+        w * px.r, w * px.g, w * px.b,
+        wx * px.r, wx * px.g, wx * px.b,
+        wy * px.r, wy * px.g, wy * px.b,
+        w * (px.r * px.r + px.g * px.g + px.b * px.b),
+        w, wx, wy, wx * x, wx * y, wy * y,
+      };
+
+      int above = y * stride + x + 1;
+      int here = above + stride;
+      for (int p = 0; p < SAT_PLANES; p++) {
+        rowSums[p] += values[p];
+        stats.sat[p][here] = stats.sat[p][above] + rowSums[p];
+      }
+    }
+  }
+
+  return stats;
+}
+
+// Recomputes the canvas integral images on rows y0.. and columns x0.., the
+// only entries a change at or after (x0, y0) can reach.
+static void RefreshCanvasSat(ImageStats& stats, int x0, int y0) {
+  int stride = stats.width + 1;
+  const std::vector<int>* ints[3] = {&stats.cr, &stats.cg, &stats.cb};
+  const std::vector<long long>* longs[3] = {&stats.csq, &stats.cross, &stats.err};
+
+  for (int p = 0; p < CANVAS_SAT_PLANES; p++) {
+    long long* sat = stats.canvasSat[p].data();
+    for (int y = y0; y < stats.height; y++) {
+      int above = y * stride;
+      int here = above + stride;
+      if (p < 3) {
+        const int* row = ints[p]->data() + y * stride;
+        for (int x = x0; x <= stats.width; x++) {
+          sat[here + x] = sat[above + x] + row[x];
+        }
+      } else {
+        const long long* row = longs[p - 3]->data() + y * stride;
+        for (int x = x0; x <= stats.width; x++) {
+          sat[here + x] = sat[above + x] + row[x];
+        }
+      }
+    }
+  }
+}
+
+void BuildCanvasSat(ImageStats& stats) {
+  size_t satSize = (size_t)(stats.width + 1) * (stats.height + 1);
+  for (std::vector<long long>& plane : stats.canvasSat) {
+    plane.assign(satSize, 0);
+  }
+  RefreshCanvasSat(stats, 0, 0);
+}
+
+// Re-sums blocks [bx0, bx1) x [by0, by1) from the error row prefixes, then
+// the block integral image from (bx0, by0) on.
+static void RefreshErrorBlocks(ImageStats& stats, int bx0, int by0, int bx1, int by1) {
+  int stride = stats.width + 1;
+  for (int by = by0; by < by1; by++) {
+    int y0 = by * ERROR_BLOCK_SIZE;
+    int y1 = std::min(y0 + ERROR_BLOCK_SIZE, stats.height);
+    for (int bx = bx0; bx < bx1; bx++) {
+      int x0 = bx * ERROR_BLOCK_SIZE;
+      int x1 = std::min(x0 + ERROR_BLOCK_SIZE, stats.width);
+      long long sum = 0;
+      for (int y = y0; y < y1; y++) {
+        sum += stats.err[y * stride + x1] - stats.err[y * stride + x0];
+      }
+      stats.blockErr[by * stats.blockCols + bx] = sum;
+    }
+  }
+
+  int satStride = stats.blockCols + 1;
+  for (int by = by0; by < stats.blockRows; by++) {
+    long long* above = &stats.blockErrSat[by * satStride];
+    long long* here = above + satStride;
+    long long rowSum = 0;
+    for (int bx = 0; bx < stats.blockCols; bx++) {
+      rowSum += stats.blockErr[by * stats.blockCols + bx];
+      if (bx >= bx0) {
+        here[bx + 1] = above[bx + 1] + rowSum;
+      }
+    }
+  }
+}
+
+void BuildErrorBlocks(ImageStats& stats) {
+  stats.blockCols = (stats.width + ERROR_BLOCK_SIZE - 1) / ERROR_BLOCK_SIZE;
+  stats.blockRows = (stats.height + ERROR_BLOCK_SIZE - 1) / ERROR_BLOCK_SIZE;
+  stats.blockErr.assign((size_t)stats.blockCols * stats.blockRows, 0);
+  stats.blockErrSat.assign((size_t)(stats.blockCols + 1) * (stats.blockRows + 1), 0);
+  RefreshErrorBlocks(stats, 0, 0, stats.blockCols, stats.blockRows);
+}
+
+long long BlockErrorBound(const ImageStats& stats, SpanBox box) {
+  if (box.x1 <= box.x0 || box.y1 <= box.y0) {
+    return 0;
+  }
+
+  int bx0 = box.x0 / ERROR_BLOCK_SIZE;
+  int by0 = box.y0 / ERROR_BLOCK_SIZE;
+  int bx1 = (box.x1 + ERROR_BLOCK_SIZE - 1) / ERROR_BLOCK_SIZE;
+  int by1 = (box.y1 + ERROR_BLOCK_SIZE - 1) / ERROR_BLOCK_SIZE;
+  int stride = stats.blockCols + 1;
+  const long long* s = stats.blockErrSat.data();
+  return s[by1 * stride + bx1] - s[by0 * stride + bx1] - s[by1 * stride + bx0] + s[by0 * stride + bx0];
+}
+
+void UpdateImageStats(ImageStats& stats, Image current, Image original, const std::vector<Span>& spans) {
+  int minX = stats.width;
+  int minY = stats.height;
+  for (const Span& s : spans) {
+    BuildCanvasRow(stats, Pixels(current), Pixels(original), s.y, s.x0);
+    minX = std::min(minX, s.x0);
+    minY = std::min(minY, s.y);
+  }
+
+  if (!stats.canvasSat[0].empty() && !spans.empty()) {
+    // Row prefixes changed from x0 + 1 onward.
+    RefreshCanvasSat(stats, minX + 1, minY);
+  }
+
+  if (!stats.blockErr.empty() && !spans.empty()) {
+    // Pixel errors only changed inside the spans.
+    SpanBox box = GetSpanBox(spans);
+    RefreshErrorBlocks(stats, box.x0 / ERROR_BLOCK_SIZE, box.y0 / ERROR_BLOCK_SIZE,
+                       (box.x1 + ERROR_BLOCK_SIZE - 1) / ERROR_BLOCK_SIZE,
+                       (box.y1 + ERROR_BLOCK_SIZE - 1) / ERROR_BLOCK_SIZE);
+  }
+}
+
+SpanBox GetSpanBox(const std::vector<Span>& spans) {
+  SpanBox box;
+  if (spans.empty()) {
+    return box;
+  }
+
+  box.x0 = spans.front().x0;
+  box.x1 = spans.front().x1;
+  box.y0 = spans.front().y;
+  box.y1 = spans.back().y + 1;
+  for (const Span& s : spans) {
+    box.x0 = std::min(box.x0, s.x0);
+    box.x1 = std::max(box.x1, s.x1);
+  }
+  return box;
+}
+
+SpanSums SumSpans(const ImageStats& stats, const std::vector<Span>& spans) {
+  SpanSums sums;
+  int stride = stats.width + 1;
+
+  for (const Span& s : spans) {
+    int a = s.y * stride + s.x0;
+    int b = s.y * stride + s.x1;
+    sums.r += stats.r[b] - stats.r[a];
+    sums.g += stats.g[b] - stats.g[a];
+    sums.b += stats.b[b] - stats.b[a];
+    sums.sq += stats.sq[b] - stats.sq[a];
+    sums.n += stats.n[b] - stats.n[a];
+
+    sums.cr += stats.cr[b] - stats.cr[a];
+    sums.cg += stats.cg[b] - stats.cg[a];
+    sums.cb += stats.cb[b] - stats.cb[a];
+    sums.csq += stats.csq[b] - stats.csq[a];
+    sums.cross += stats.cross[b] - stats.cross[a];
+  }
+
+  return sums;
+}
+
+long long SumSpansError(const ImageStats& stats, const std::vector<Span>& spans) {
+  long long e = 0;
+  int stride = stats.width + 1;
+
+  for (const Span& s : spans) {
+    e += stats.err[s.y * stride + s.x1] - stats.err[s.y * stride + s.x0];
+  }
+
+  return e;
+}
+
+static unsigned char BlendChannel(long long org, long long cur, long long n, double alpha) {
+  // Minimizes sum((alpha*c + (1 - alpha)*cur - org)^2) over c.
+  double c = (org - (1.0 - alpha) * cur) / (n * alpha);
+  return (unsigned char)std::clamp(std::lround(c), 0L, 255L);
+}
+
+long long SumSpansErrorL1(const ImageStats& stats, const std::vector<Span>& spans) {
+  long long e = 0;
+  int stride = stats.width + 1;
+
+  for (const Span& s : spans) {
+    e += stats.errL1[s.y * stride + s.x1] - stats.errL1[s.y * stride + s.x0];
+  }
+
+  return e;
+}
+
+long long SpansColorErrorL1(const ImageStats& stats, const std::vector<Span>& spans, Color c) {
+  long long e = 0;
+  const Color* org = Pixels(stats.original);
+
+  for (const Span& s : spans) {
+    const Color* row = org + (size_t)s.y * stats.width;
+    for (int x = s.x0; x < s.x1; x++) {
+      e += abs(c.r - row[x].r) + abs(c.g - row[x].g) + abs(c.b - row[x].b);
+    }
+  }
+
+  return e;
+}
+
+Color GetBestSpanColor(const SpanSums& sums, unsigned char alpha) {
+  if (sums.n == 0 || alpha == 0) {
+    return Color{0, 0, 0, 255};
+  }
+
+  Color c;
+  if (alpha == 255) {
+    c.r = (unsigned char)(sums.r / sums.n);
+    c.g = (unsigned char)(sums.g / sums.n);
+    c.b = (unsigned char)(sums.b / sums.n);
+  } else {
+    double a = alpha / 255.0;
+    c.r = BlendChannel(sums.r, sums.cr, sums.n, a);
+    c.g = BlendChannel(sums.g, sums.cg, sums.n, a);
+    c.b = BlendChannel(sums.b, sums.cb, sums.n, a);
+  }
+  c.a = alpha;
+
+  return c;
+}
+
+float SpanDeltaError(const SpanSums& sums, long long before, Color c) {
+  if (c.a == 255) {
+    // sum((c - org)^2) = n*c^2 - 2*c*sum(org) + sum(org^2), per channel
+    long long after = sums.sq
+      + sums.n * (c.r * c.r + c.g * c.g + c.b * c.b)
+      - 2 * (c.r * sums.r + c.g * sums.g + c.b * sums.b);
+
+    return (float)(before - after);
+  }
+
+  // With t = org - (1 - a)*cur the blended error is sum((a*c - t)^2).
+  double a = c.a / 255.0;
+  double k = 1.0 - a;
+  double tr = sums.r - k * sums.cr;
+  double tg = sums.g - k * sums.cg;
+  double tb = sums.b - k * sums.cb;
+  double tsq = sums.sq - 2.0 * k * sums.cross + k * k * sums.csq;
+
+  double after = tsq
+    + a * a * sums.n * (c.r * c.r + c.g * c.g + c.b * c.b)
+    - 2.0 * a * (c.r * tr + c.g * tg + c.b * tb);
+
+  return (float)(before - after);
+}
+
+float FitSpanColor(const SpanSums& sums, long long before, Color& c) {
+  c = GetBestSpanColor(sums);
+  float gain = SpanDeltaError(sums, before, c);
+
+  if (BLEND_SHAPES) {
+    for (unsigned char alpha : ALPHA_LEVELS) {
+      Color blended = GetBestSpanColor(sums, alpha);
+      float d = SpanDeltaError(sums, before, blended);
+      if (d > gain) {
+        gain = d;
+        c = blended;
+      }
+    }
+  }
+
+  return gain;
+}
+
+void DrawSpans(Image* dst, const std::vector<Span>& spans, Color c) {
+  Color* px = (Color*)dst->data;
+
+  if (c.a == 255) {
+    for (const Span& s : spans) {
+      std::fill(px + s.y * dst->width + s.x0, px + s.y * dst->width + s.x1, c);
+    }
+    return;
+  }
+
+  int a = c.a;
+  int k = 255 - a;
+  for (const Span& s : spans) {
+    Color* row = px + s.y * dst->width;
+    for (int x = s.x0; x < s.x1; x++) {
+      row[x].r = (unsigned char)((c.r * a + row[x].r * k + 127) / 255);
+      row[x].g = (unsigned char)((c.g * a + row[x].g * k + 127) / 255);
+      row[x].b = (unsigned char)((c.b * a + row[x].b * k + 127) / 255);
+      row[x].a = 255;
+    }
+  }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <vector>
+
+#include "../include/raylib.h"
+
+// Half-open run of pixels [x0, x1) on row y. Shapes rasterize into at most
+// one span per row, ordered by y.
+struct Span {
+  int y;
+  int x0;
+  int x1;
+};
+
+// Bounding box [x0, x1) x [y0, y1) of a set of spans; empty when x1 <= x0.
+struct SpanBox {
+  int x0 = 0, y0 = 0;
+  int x1 = 0, y1 = 0;
+};
+
+// With a weight map every sum is weighted per pixel, and n is the total
+// weight rather than the pixel count.
+struct SpanSums {
+  long long r = 0, g = 0, b = 0;
+  long long sq = 0; // sum of r*r + g*g + b*b
+  long long n = 0;
+
+  // Same sums over the current canvas, plus the canvas/original cross term.
+  long long cr = 0, cg = 0, cb = 0;
+  long long csq = 0;
+  long long cross = 0; // sum of cur.r*org.r + cur.g*org.g + cur.b*org.b
+};
+
+// Planes of the 2D integral images over the original: channel values, their
+// first moments x*I and y*I, the squared sum, and the weight with its
+// coordinate moments. All of them are weighted when a weight map is set.
+enum SatPlane {
+  SAT_R = 0, SAT_G, SAT_B,
+  SAT_XR, SAT_XG, SAT_XB,
+  SAT_YR, SAT_YG, SAT_YB,
+  SAT_SQ,
+  SAT_W, SAT_WX, SAT_WY, SAT_WXX, SAT_WXY, SAT_WYY,
+  SAT_PLANES,
+};
+
+// Canvas planes of the 2D integral images, for scoring rectangles against the
+// canvas in four reads: channel values, squared sum, canvas/original cross
+// term and the current error.
+enum CanvasSatPlane {
+  CSAT_R = 0, CSAT_G, CSAT_B,
+  CSAT_SQ, CSAT_CROSS, CSAT_ERR,
+  CANVAS_SAT_PLANES,
+};
+
+// Side of the square blocks the current error is summed over for gain bounds.
+constexpr int ERROR_BLOCK_SIZE = 8;
+
+// Row prefix sums over the original image and over the current canvas. Each
+// row stores width + 1 entries so a span costs two reads per plane. The
+// original also gets (width + 1) x (height + 1) integral images so rectangle
+// moments cost four reads.
+struct ImageStats {
+  int width = 0;
+  int height = 0;
+
+  // The images the sums were built from, for scorers that need raw pixels.
+  Image original;
+  Image current;
+
+  std::vector<int> r, g, b;
+  std::vector<long long> sq;
+  std::vector<int> n;
+
+  std::vector<int> cr, cg, cb;
+  std::vector<long long> csq, cross;
+  std::vector<long long> err;
+  std::vector<long long> errL1; // sum of |cur - org| over the channels, unweighted
+
+  std::vector<long long> sat[SAT_PLANES];
+
+  // Canvas prefixes accumulated down the columns, same layout as sat. Empty
+  // unless BuildCanvasSat was called; UpdateImageStats keeps them current.
+  std::vector<long long> canvasSat[CANVAS_SAT_PLANES];
+
+  // Current error per ERROR_BLOCK_SIZE block (edge blocks are smaller) and its
+  // (blockCols + 1) x (blockRows + 1) integral image. Empty unless
+  // BuildErrorBlocks was called; UpdateImageStats keeps them current.
+  int blockCols = 0;
+  int blockRows = 0;
+  std::vector<long long> blockErr;
+  std::vector<long long> blockErrSat;
+
+  // Only built for the robust (L1) color mode.
+  const struct IntegralHistogram* histogram = nullptr;
+
+  // Optional importance map; also drives candidate placement.
+  const struct WeightMap* weights = nullptr;
+};
+
+// Weight of a pixel, 1 without a weight map.
+int PixelWeight(const ImageStats& stats, int x, int y);
+
+// Both images must be PIXELFORMAT_UNCOMPRESSED_R8G8B8A8.
+inline const Color* Pixels(Image img) {
+  return (const Color*)img.data;
+}
+
+ImageStats BuildImageStats(Image original, Image current, const struct WeightMap* weights = nullptr);
+
+// Refreshes the canvas prefixes of every row touched by spans after a commit.
+void UpdateImageStats(ImageStats& stats, Image current, Image original, const std::vector<Span>& spans);
+
+// Builds the canvas integral images from the row prefixes. Costs a pass over
+// the image and makes every commit refresh the area below and right of it.
+void BuildCanvasSat(ImageStats& stats);
+
+// Sums the current error into blocks. Cheap to keep up: a commit only
+// refreshes the blocks under it and the block integral image below and right.
+void BuildErrorBlocks(ImageStats& stats);
+
+// Current error of every block the box touches: an upper bound on the error
+// inside the box, and so on the gain of any shape within it. 0 for an empty
+// box. Needs BuildErrorBlocks.
+long long BlockErrorBound(const ImageStats& stats, SpanBox box);
+
+// Sum of a plane over the rectangle [x0, x1) x [y0, y1).
+inline long long SatSum(const ImageStats& stats, SatPlane plane, int x0, int y0, int x1, int y1) {
+  int stride = stats.width + 1;
+  const std::vector<long long>& s = stats.sat[plane];
+  return s[y1 * stride + x1] - s[y0 * stride + x1] - s[y1 * stride + x0] + s[y0 * stride + x0];
+}
+
+SpanBox GetSpanBox(const std::vector<Span>& spans);
+
+SpanSums SumSpans(const ImageStats& stats, const std::vector<Span>& spans);
+long long SumSpansError(const ImageStats& stats, const std::vector<Span>& spans);
+long long SumSpansErrorL1(const ImageStats& stats, const std::vector<Span>& spans);
+
+// Exact sum of |c - org| over the spans and channels, unweighted: the L1
+// error left after drawing c opaque.
+long long SpansColorErrorL1(const ImageStats& stats, const std::vector<Span>& spans, Color c);
+
+// Least-squares color for the spans when blended over the canvas with the
+// given alpha. With alpha 255 this is the mean of the original.
+Color GetBestSpanColor(const SpanSums& sums, unsigned char alpha = 255);
+
+// Error removed by blending c (using c.a) over the spans, computed without
+// touching pixels.
+float SpanDeltaError(const SpanSums& sums, long long before, Color c);
+
+// Best flat color over the sums: the opaque fit, or one of ALPHA_LEVELS when
+// blending is enabled and removes more error. Returns the gain.
+float FitSpanColor(const SpanSums& sums, long long before, Color& c);
+
+// Blends c over the spans; opaque colors are copied straight in.
+void DrawSpans(Image* dst, const std::vector<Span>& spans, Color c);
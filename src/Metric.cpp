@@ -0,0 +1,153 @@
+#include "Metric.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// Lab channels are stored as LAB_SCALE * L and 128 + LAB_SCALE * a/b, which
+// keeps one delta E per unit across all three channels.
+constexpr float LAB_SCALE = 1.15f;
+
+static const float NEUTRAL[3][3] = {
+  {0.0f, 0.0f, 0.0f},     // RGB
+  {0.0f, 128.0f, 128.0f}, // YCbCr
+  {0.0f, 128.0f, 128.0f}, // Lab
+};
+
+Metric CreateMetric(MetricType type) {
+  switch (type) {
+    case METRIC_YCBCR: return Metric{type, {1.0f, 0.5f, 0.5f}};
+    case METRIC_LAB: return Metric{type, {1.0f, 1.0f, 1.0f}};
+    default: return Metric{METRIC_RGB, {1.0f, 1.0f, 1.0f}};
+  }
+}
+
+static unsigned char ToByte(float v) {
+  return (unsigned char)std::clamp((int)lroundf(v), 0, 255);
+}
+
+static float SrgbToLinear(float v) {
+  return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgb(float v) {
+  return v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1.0f / 2.4f) - 0.055f;
+}
+
+static float LabF(float t) {
+  return t > 216.0f / 24389.0f ? cbrtf(t) : (24389.0f / 27.0f * t + 16.0f) / 116.0f;
+}
+
+static float LabFInverse(float t) {
+  return t * t * t > 216.0f / 24389.0f ? t * t * t : (116.0f * t - 16.0f) * 27.0f / 24389.0f;
+}
+
+// D65 white point.
+constexpr float WHITE_X = 0.95047f;
+constexpr float WHITE_Z = 1.08883f;
+
+static void RgbToLab(Color rgb, float out[3]) {
+  float r = SrgbToLinear(rgb.r / 255.0f);
+  float g = SrgbToLinear(rgb.g / 255.0f);
+  float b = SrgbToLinear(rgb.b / 255.0f);
+
+  float x = (0.4124f * r + 0.3576f * g + 0.1805f * b) / WHITE_X;
+  float y = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+  float z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / WHITE_Z;
+
+  float fx = LabF(x), fy = LabF(y), fz = LabF(z);
+  out[0] = LAB_SCALE * (116.0f * fy - 16.0f);
+  out[1] = 128.0f + LAB_SCALE * 500.0f * (fx - fy);
+  out[2] = 128.0f + LAB_SCALE * 200.0f * (fy - fz);
+}
+
+static Color LabToRgb(const float lab[3]) {
+  float fy = (lab[0] / LAB_SCALE + 16.0f) / 116.0f;
+  float fx = fy + (lab[1] - 128.0f) / (LAB_SCALE * 500.0f);
+  float fz = fy - (lab[2] - 128.0f) / (LAB_SCALE * 200.0f);
+
+  float x = LabFInverse(fx) * WHITE_X;
+  float y = LabFInverse(fy);
+  float z = LabFInverse(fz) * WHITE_Z;
+
+  float r = 3.2406f * x - 1.5372f * y - 0.4986f * z;
+  float g = -0.9689f * x + 1.8758f * y + 0.0415f * z;
+  float b = 0.0557f * x - 0.2040f * y + 1.0570f * z;
+
+  return Color{
+    ToByte(255.0f * LinearToSrgb(std::clamp(r, 0.0f, 1.0f))),
+    ToByte(255.0f * LinearToSrgb(std::clamp(g, 0.0f, 1.0f))),
+    ToByte(255.0f * LinearToSrgb(std::clamp(b, 0.0f, 1.0f))),
+    255,
+  };
+}
+
+Color ToMetric(const Metric& metric, Color rgb) {
+  if (metric.type == METRIC_RGB) {
+    return rgb;
+  }
+
+  float v[3];
+  if (metric.type == METRIC_YCBCR) {
+    v[0] = 0.299f * rgb.r + 0.587f * rgb.g + 0.114f * rgb.b;
+    v[1] = 128.0f - 0.168736f * rgb.r - 0.331264f * rgb.g + 0.5f * rgb.b;
+    v[2] = 128.0f + 0.5f * rgb.r - 0.418688f * rgb.g - 0.081312f * rgb.b;
+  } else {
+    RgbToLab(rgb, v);
+  }
+
+  const float* neutral = NEUTRAL[metric.type];
+  Color c;
+  c.r = ToByte(neutral[0] + metric.weights[0] * (v[0] - neutral[0]));
+  c.g = ToByte(neutral[1] + metric.weights[1] * (v[1] - neutral[1]));
+  c.b = ToByte(neutral[2] + metric.weights[2] * (v[2] - neutral[2]));
+  c.a = rgb.a;
+  return c;
+}
+
+Color FromMetric(const Metric& metric, Color c) {
+  if (metric.type == METRIC_RGB) {
+    return c;
+  }
+
+  const float* neutral = NEUTRAL[metric.type];
+  float v[3] = {(float)c.r, (float)c.g, (float)c.b};
+  for (int ch = 0; ch < 3; ch++) {
+    v[ch] = neutral[ch] + (v[ch] - neutral[ch]) / metric.weights[ch];
+  }
+
+  if (metric.type == METRIC_LAB) {
+    return LabToRgb(v);
+  }
+
+  float cb = v[1] - 128.0f;
+  float cr = v[2] - 128.0f;
+  return Color{
+    ToByte(v[0] + 1.402f * cr),
+    ToByte(v[0] - 0.344136f * cb - 0.714136f * cr),
+    ToByte(v[0] + 1.772f * cb),
+    255,
+  };
+}
+
+void ConvertImageToMetric(const Metric& metric, Image* img) {
+  if (metric.type == METRIC_RGB) {
+    return;
+  }
+
+  Color* px = (Color*)img->data;
+  for (int i = 0; i < img->width * img->height; i++) {
+    px[i] = ToMetric(metric, px[i]);
+  }
+}
+
+void ConvertSpansFromMetric(const Metric& metric, Image canvas, Image* display, const std::vector<Span>& spans) {
+  const Color* src = Pixels(canvas);
+  Color* dst = (Color*)display->data;
+
+  for (const Span& s : spans) {
+    int row = s.y * canvas.width;
+    for (int x = s.x0; x < s.x1; x++) {
+      dst[row + x] = FromMetric(metric, src[row + x]);
+    }
+  }
+}
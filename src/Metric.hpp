@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "../include/raylib.h"
+#include "ImageStats.hpp"
+
+enum MetricType {
+  METRIC_RGB = 0,
+  METRIC_YCBCR,
+  METRIC_LAB,
+};
+
+// Color space the optimizer works in. The original is converted once into
+// weighted 8-bit planes, so squared error there is the weighted perceptual
+// error and every prefix sum and integral image applies unchanged. Weights
+// scale each channel around its neutral value; keep them at or below 1 so the
+// planes stay in range.
+struct Metric {
+  MetricType type;
+  float weights[3];
+};
+
+Metric CreateMetric(MetricType type);
+
+Color ToMetric(const Metric& metric, Color rgb);
+Color FromMetric(const Metric& metric, Color c);
+
+void ConvertImageToMetric(const Metric& metric, Image* img);
+
+// Writes the RGB version of the canvas spans into display after a commit.
+void ConvertSpansFromMetric(const Metric& metric, Image canvas, Image* display, const std::vector<Span>& spans);
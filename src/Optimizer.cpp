@@ -0,0 +1,400 @@
+#include "Optimizer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+
+#include "Random.hpp"
+#include "Rects.hpp"
+#include "ShapeFile.hpp"
+#include "Subdivide.hpp"
+#include "Superpixel.hpp"
+#include "Trace.hpp"
+
+struct ThreadResult {
+  float bestError = -1e30f;
+  int bestIndex = -1;
+};
+
+static void RaiseThreshold(std::atomic<float>& threshold, float gain) {
+  float seen = threshold.load(std::memory_order_relaxed);
+  while (gain > seen && !threshold.compare_exchange_weak(seen, gain, std::memory_order_relaxed)) {
+  }
+}
+
+// One full-frame rectangle in the mean color of the original.
+static Shape MeanFill(const Optimizer& opt) {
+  Shape fill{};
+  fill.type = SHAPE_RECTANGLE;
+  fill.width = (float)opt.width;
+  fill.height = (float)opt.height;
+  SpanSums sums;
+  sums.r = SatSum(opt.stats, SAT_R, 0, 0, opt.width, opt.height);
+  sums.g = SatSum(opt.stats, SAT_G, 0, 0, opt.width, opt.height);
+  sums.b = SatSum(opt.stats, SAT_B, 0, 0, opt.width, opt.height);
+  sums.n = SatSum(opt.stats, SAT_W, 0, 0, opt.width, opt.height);
+  fill.c = GetBestSpanColor(sums);
+  return fill;
+}
+
+static void InitializeCanvas(Optimizer& opt) {
+  const OptimizerSettings& settings = opt.settings;
+
+  switch (settings.init) {
+    case INIT_BLACK:
+      break;
+    case INIT_MEAN:
+      CommitShape(opt, MeanFill(opt));
+      break;
+    case INIT_SUBDIVIDE:
+      CommitShapes(opt, SubdivideImage(opt.stats, SUBDIVIDE_VARIANCE, SUBDIVIDE_MIN_SIZE, settings.threads));
+      break;
+    case INIT_SUPERPIXEL:
+      // The ellipses leave gaps between them, which keep the mean.
+      CommitShape(opt, MeanFill(opt));
+      CommitShapes(opt, SuperpixelShapes(opt.stats, SHAPE_ELLIPSE, SUPERPIXEL_COUNT, SUPERPIXEL_COMPACTNESS,
+                                         settings.threads));
+      break;
+    case INIT_SHAPE_FILE: {
+      ShapeFileInfo info;
+      std::vector<Shape> shapes;
+      if (!LoadShapes(settings.initShapesPath, info, shapes)) {
+        TraceLog(LOG_WARNING, "OPTIMIZER: Shape file %s could not be loaded, starting from scratch",
+                 settings.initShapesPath);
+      } else if (info.width != opt.width || info.height != opt.height) {
+        TraceLog(LOG_WARNING, "OPTIMIZER: Shape file %s is for %dx%d, not %dx%d, starting from scratch",
+                 settings.initShapesPath, info.width, info.height, opt.width, opt.height);
+      } else if (info.metric != settings.metric) {
+        TraceLog(LOG_WARNING, "OPTIMIZER: Shape file %s uses metric %d, not %d, starting from scratch",
+                 settings.initShapesPath, (int)info.metric, (int)settings.metric);
+      } else {
+        CommitShapes(opt, shapes);
+        // Iteration and seed together pick up the random streams where the
+        // saved run left off.
+        opt.iteration = info.iteration;
+        if (info.seed != 0) {
+          opt.settings.seed = info.seed;
+          SeedRandom(info.seed);
+        }
+      }
+      break;
+    }
+  }
+}
+
+void InitOptimizer(Optimizer& opt, Image original, const OptimizerSettings& settings) {
+  opt.settings = settings;
+  if (opt.settings.seed == 0) {
+    std::random_device device;
+    opt.settings.seed = ((unsigned long long)device() << 32) | device();
+  }
+  SeedRandom(opt.settings.seed);
+  opt.width = original.width;
+  opt.height = original.height;
+  opt.iteration = 0;
+  int w = opt.width;
+  int h = opt.height;
+
+  opt.original = ImageCopy(original);
+  ImageFormat(&opt.original, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+
+  // The optimizer works on canvas in metric space; display holds the RGB
+  // version that gets shown.
+  opt.metric = CreateMetric(settings.metric);
+  opt.display = GenImageColor(w, h, BLACK);
+  ImageFormat(&opt.display, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  opt.canvas = GenImageColor(w, h, ToMetric(opt.metric, BLACK));
+  ImageFormat(&opt.canvas, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  opt.weights = BuildWeightMap(settings.weights, opt.original, settings.weightMaskPath);
+
+  if (opt.settings.useRoi) {
+    opt.roi = LoadRoiMask(settings.roiMaskPath, w, h);
+    if (opt.roi.w.empty()) {
+      TraceLog(LOG_WARNING, "OPTIMIZER: No region of interest mask, using the whole image");
+      opt.settings.useRoi = false;
+    }
+  }
+
+  if (opt.settings.useRoi) {
+    Color mean = FillOutsideMask(opt.roi, opt.original, &opt.display);
+    Color* px = (Color*)opt.canvas.data;
+    for (int i = 0; i < w * h; i++) {
+      if (opt.roi.w[i] == 0) {
+        px[i] = ToMetric(opt.metric, mean);
+      }
+    }
+
+    if (opt.weights.w.empty()) {
+      opt.weights = opt.roi;
+    } else {
+      ApplyRoi(opt.weights, opt.roi);
+    }
+  }
+
+  opt.ssim = CreateSsimTracker(opt.original, opt.display);
+  opt.telemetry = CreateSearchTelemetry(opt.original, opt.display, settings.telemetryPath, settings.telemetryHistogramPath);
+  ConvertImageToMetric(opt.metric, &opt.original);
+
+  // A mask that failed to load leaves the map empty and scoring unweighted.
+  bool weighted = !opt.weights.w.empty();
+  opt.stats = BuildImageStats(opt.original, opt.canvas, weighted ? &opt.weights : nullptr);
+
+  // The integral histograms count every pixel alike, so robust colors would
+  // score and color against pixels the weights discount or the region of
+  // interest leaves out.
+  if (opt.settings.robustColors && weighted) {
+    TraceLog(LOG_WARNING, "OPTIMIZER: Robust colors ignore weights and regions of interest, disabling them");
+    opt.settings.robustColors = false;
+  }
+
+  if (opt.settings.robustColors) {
+    opt.histogram = BuildIntegralHistogram(opt.original);
+    opt.stats.histogram = &opt.histogram;
+  }
+
+  if (opt.settings.mixedShapes && opt.settings.mixedTypes.empty()) {
+    TraceLog(LOG_WARNING, "OPTIMIZER: No shape types to mix, using the single shape type");
+    opt.settings.mixedShapes = false;
+  }
+
+  bool rectangles = opt.settings.mixedShapes
+    ? std::find(settings.mixedTypes.begin(), settings.mixedTypes.end(), SHAPE_RECTANGLE) != settings.mixedTypes.end()
+    : settings.shapeType == SHAPE_RECTANGLE;
+  opt.batching = settings.rectangleBatch > 0 && rectangles && !opt.settings.robustColors;
+  if (opt.batching) {
+    BuildCanvasSat(opt.stats);
+  }
+
+  opt.pruning = settings.pruneCandidates && !opt.settings.robustColors;
+  if (opt.pruning || settings.quadtreeCandidates > 0) {
+    BuildErrorBlocks(opt.stats);
+  }
+  if (settings.quadtreeCandidates > 0) {
+    opt.errorTree = BuildErrorQuadtree(opt.stats);
+  }
+
+  if (opt.settings.mixedShapes) {
+    opt.mix = CreateShapeMix(settings.mixedTypes.data(), (int)settings.mixedTypes.size());
+  }
+  opt.types.resize(settings.candidates);
+  opt.shapes.resize(settings.candidates);
+  opt.gains.resize(settings.candidates);
+  opt.boxes.resize(settings.candidates);
+  opt.cache = CreateCandidateCache(settings.candidateCache, w, h);
+
+  InitializeCanvas(opt);
+}
+
+float StepOptimizer(Optimizer& opt) {
+  const OptimizerSettings& settings = opt.settings;
+  int count = settings.candidates;
+
+  if (settings.robustColors) {
+    std::fill(opt.types.begin(), opt.types.end(), SHAPE_RECTANGLE);
+  } else if (settings.mixedShapes) {
+    AllocateCandidates(opt.mix, count, opt.types.data());
+  } else {
+    std::fill(opt.types.begin(), opt.types.end(), settings.shapeType);
+  }
+
+  int numThreads = settings.threads > 0 ? settings.threads : (int)std::thread::hardware_concurrency();
+  numThreads = std::max(1, std::min(numThreads, count));
+
+  std::vector<ThreadResult> results(numThreads);
+  std::vector<std::thread> threads;
+
+  int chunkSize = count / numThreads;
+  int batchCount = opt.batching ? settings.rectangleBatch : 0;
+  int treeCount = std::min(settings.quadtreeCandidates, count);
+
+  if (opt.batching) {
+    TraceScope trace(PHASE_GENERATE);
+    SetRandomStream(opt.iteration, count + 1);
+    GenerateRectBatch(opt.batch, batchCount, opt.stats, (float)opt.iteration);
+  }
+
+  // Best gain scored so far this iteration, across threads. A candidate is
+  // only skipped when its bound is below it and cannot beat the cache floor
+  // either, so neither the winner nor the cache depend on thread timing.
+  std::atomic<float> threshold{-1e30f};
+  float cacheFloor = settings.candidateCache > 0 ? CandidateCacheFloor(opt.cache) : 1e30f;
+
+  auto worker = [&](int tid, int start, int end) {
+    ThreadResult local;
+    std::vector<Span> spans;
+
+    for (int i = start; i < end; i++) {
+      {
+        TraceScope trace(PHASE_GENERATE);
+        SetRandomStream(opt.iteration, i);
+        // Spread the quadtree placements evenly over the indices, and so over
+        // the types a shape mix allocated.
+        int x, y, size;
+        if ((long long)i * treeCount % count < treeCount &&
+            SampleErrorQuadtree(opt.errorTree, MaxShapeSize((float)opt.iteration), x, y, size)) {
+          opt.shapes[i] = GenerateShapeAt(opt.types[i], opt.stats, (float)x, (float)y, size);
+        } else {
+          opt.shapes[i] = GenerateRandomShape(opt.types[i], opt.stats, (float)opt.iteration);
+        }
+      }
+      float d = PRUNED_GAIN;
+      {
+        TraceScope trace(PHASE_SCORE);
+        // Padded for the rounding in the fits, which can land a hair above
+        // the error they remove.
+        float bound = 1e30f;
+        if (opt.pruning) {
+          bound = (float)BlockErrorBound(opt.stats, ShapeBounds(opt.shapes[i], opt.width, opt.height)) * 1.0001f + 1.0f;
+        }
+        if (bound >= threshold.load(std::memory_order_relaxed) || bound > cacheFloor) {
+          d = ScoreShape(opt.shapes[i], opt.stats, spans);
+        }
+      }
+      opt.gains[i] = d;
+      if (d == PRUNED_GAIN) {
+        continue;
+      }
+      opt.boxes[i] = GetSpanBox(spans);
+
+      if (d > local.bestError) {
+        local.bestError = d;
+        local.bestIndex = i;
+        RaiseThreshold(threshold, d);
+      }
+    }
+
+    if (batchCount > 0) {
+      TraceScope trace(PHASE_SCORE);
+      ScoreRectBatch(opt.batch, opt.stats, batchCount * tid / numThreads, batchCount * (tid + 1) / numThreads);
+    }
+
+    results[tid] = local;
+  };
+
+  for (int t = 0; t < numThreads; t++) {
+    int start = t * chunkSize;
+    int end = (t == numThreads - 1)
+      ? count
+      : start + chunkSize;
+
+    threads.emplace_back(worker, t, start, end);
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  float besterror = -1e30f;
+  int bestrect = 0;
+
+  {
+    TraceScope trace(PHASE_REDUCE);
+    for (const auto& r : results) {
+      if (r.bestIndex >= 0 && r.bestError > besterror) {
+        besterror = r.bestError;
+        bestrect = r.bestIndex;
+      }
+    }
+  }
+
+  RecordCandidates(opt.telemetry, opt.shapes.data(), opt.gains.data(), count);
+  if (settings.mixedShapes && !settings.robustColors) {
+    // The bandit only judges the types it allocated against each other.
+    UpdateShapeMix(opt.mix, opt.types.data(), count, opt.shapes[bestrect].type);
+  }
+
+  Shape best = opt.shapes[bestrect];
+  if (batchCount > 0) {
+    TraceScope trace(PHASE_REDUCE);
+    int i = BestInRectBatch(opt.batch, 0, batchCount);
+    if (opt.batch.gain[i] > besterror) {
+      besterror = opt.batch.gain[i];
+      best = RectBatchShape(opt.batch, i);
+    }
+  }
+
+  if (settings.candidateCache > 0) {
+    // Fresh candidates join the survivors of earlier iterations; the best of
+    // them all wins unless the batch found better.
+    TraceScope trace(PHASE_REDUCE);
+    for (int i = 0; i < count; i++) {
+      OfferCandidate(opt.cache, opt.shapes[i], opt.gains[i], opt.boxes[i]);
+    }
+    if (RefreshBestCandidate(opt.cache, opt.stats) > besterror) {
+      TakeBestCandidate(opt.cache, best, besterror);
+    }
+  }
+
+  float bestGain;
+  {
+    TraceScope trace(PHASE_REFINE);
+    SetRandomStream(opt.iteration, count);
+    bestGain = RefineShape(best, besterror, opt.stats, settings.mutations, (float)opt.iteration, opt.lastSpans);
+  }
+
+  if (settings.robustColors) {
+    // Candidates are ranked on after-errors estimated from the bins; the
+    // winner's is measured exactly, so a shape that does not help shows up
+    // as such.
+    TraceScope trace(PHASE_COLOR);
+    best.c = RefineMedianColor(opt.histogram, Rectangle{best.x, best.y, best.width, best.height}, opt.original);
+    RasterizeShape(best, opt.width, opt.height, opt.lastSpans);
+    bestGain = (float)(SumSpansErrorL1(opt.stats, opt.lastSpans) - SpansColorErrorL1(opt.stats, opt.lastSpans, best.c));
+  }
+
+  CommitShape(opt, best);
+  RecordCommit(opt.telemetry, opt.iteration, best, bestGain);
+
+  opt.iteration++;
+  return bestGain;
+}
+
+void CommitShape(Optimizer& opt, const Shape& shape) {
+  {
+    TraceScope trace(PHASE_COMMIT);
+    RasterizeShape(shape, opt.width, opt.height, opt.lastSpans);
+    if (opt.settings.useRoi) {
+      ClipSpansToMask(opt.roi, opt.lastSpans);
+    }
+    DrawShape(&opt.canvas, shape, opt.lastSpans);
+    UpdateImageStats(opt.stats, opt.canvas, opt.original, opt.lastSpans);
+    ConvertSpansFromMetric(opt.metric, opt.canvas, &opt.display, opt.lastSpans);
+    UpdateSsimTracker(opt.ssim, opt.display, opt.lastSpans);
+  }
+
+  SpanBox dirty = GetSpanBox(opt.lastSpans);
+  if (opt.settings.candidateCache > 0) {
+    InvalidateCandidates(opt.cache, dirty);
+  }
+  if (opt.settings.quadtreeCandidates > 0) {
+    UpdateErrorQuadtree(opt.errorTree, opt.stats, dirty);
+  }
+  RecordCanvas(opt.telemetry, opt.display, opt.lastSpans);
+
+  opt.lastShape = shape;
+  opt.committed.push_back(shape);
+}
+
+void CommitShapes(Optimizer& opt, const std::vector<Shape>& shapes) {
+  for (const Shape& shape : shapes) {
+    CommitShape(opt, shape);
+  }
+}
+
+bool SaveOptimizerShapes(const Optimizer& opt, const char* path) {
+  ShapeFileInfo info;
+  info.width = opt.width;
+  info.height = opt.height;
+  info.metric = opt.settings.metric;
+  info.iteration = opt.iteration;
+  info.seed = opt.settings.seed;
+  return SaveShapes(path, info, opt.committed);
+}
+
+void UnloadOptimizer(Optimizer& opt) {
+  CloseSearchTelemetry(opt.telemetry);
+  UnloadImage(opt.original);
+  UnloadImage(opt.canvas);
+  UnloadImage(opt.display);
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <vector>
+
+#include "../include/raylib.h"
+#include "CandidateCache.hpp"
+#include "Config.hpp"
+#include "ErrorTree.hpp"
+#include "Histogram.hpp"
+#include "ImageStats.hpp"
+#include "Metric.hpp"
+#include "RectBatch.hpp"
+#include "ShapeMix.hpp"
+#include "Shapes.hpp"
+#include "Ssim.hpp"
+#include "Telemetry.hpp"
+#include "WeightMap.hpp"
+
+// Starting points for the canvas. Initializers that draw shapes commit them
+// like the search does, so they end up in Optimizer::committed.
+enum CanvasInit {
+  INIT_BLACK = 0,  // nothing drawn
+  INIT_MEAN,       // one full-frame rectangle in the mean color
+  INIT_SUBDIVIDE,  // the SubdivideImage rectangles
+  INIT_SHAPE_FILE, // a saved shape list, resuming its iteration count and seed
+  INIT_SUPERPIXEL, // the mean, then an ellipse per SuperpixelShapes superpixel
+};
+
+struct OptimizerSettings {
+  ShapeType shapeType = SHAPE_ROTATED_RECTANGLE;
+
+  // When set, every iteration competes mixedTypes instead of shapeType alone.
+  // An empty list turns it off.
+  bool mixedShapes = true;
+  std::vector<ShapeType> mixedTypes = {
+    SHAPE_RECTANGLE,
+    SHAPE_ROTATED_RECTANGLE,
+    SHAPE_TRIANGLE,
+    SHAPE_ELLIPSE,
+    SHAPE_POLYGON,
+    SHAPE_GRADIENT_RECTANGLE,
+    SHAPE_STROKE,
+  };
+
+  // Median colors and L1 error for rectangles, robust to outliers such as
+  // specular highlights. Only rectangles support it, so it overrides the
+  // shape type and the mix. Turned off when weights or a region of interest
+  // are set, which the histograms do not account for.
+  bool robustColors = false;
+
+  // Color space the error is measured in; see Metric.hpp.
+  MetricType metric = METRIC_YCBCR;
+
+  // Per-pixel importance multiplied into the error and used for placement.
+  WeightSource weights = WEIGHTS_NONE;
+  const char* weightMaskPath = "mask.png";
+
+  // Only the white part of the mask gets shapes; the rest is filled once
+  // with its mean color and ignored by the error. Turned off when the mask
+  // cannot be loaded.
+  bool useRoi = false;
+  const char* roiMaskPath = "roi.png";
+
+  // What is on the canvas before the search starts; see CanvasInit. The mean
+  // costs one shape; INIT_SUBDIVIDE reaches a given quality several times
+  // sooner but starts the output with hundreds of rectangles.
+  CanvasInit init = INIT_MEAN;
+  const char* initShapesPath = "shapes.txt";
+
+  int candidates = NUM_RECTS_PER_ITERATION;
+
+  // Extra rectangles per iteration, generated and scored in bulk straight off
+  // the integral images (see RectBatch.hpp). Only used while rectangles are
+  // among the active types and colors are not robust; 0 disables. Pays off
+  // on rectangle-friendly images and with many cores; every commit then also
+  // refreshes the canvas integral images below and right of the shape.
+  int rectangleBatch = 0;
+
+  // Scored candidates kept across iterations (see CandidateCache.hpp); a
+  // commit only invalidates the ones it overlaps. 0 disables.
+  int candidateCache = 256;
+
+  // Skips scoring candidates whose block error bound (see BlockErrorBound)
+  // can neither win the iteration nor get into the cache; the results stay
+  // the same. Off by default: with blended fits the best fresh gain soon
+  // drops to zero or below, where no bound can prune, so it only pays while
+  // large gains are still around. Ignored with robustColors, which scores
+  // in L1.
+  bool pruneCandidates = false;
+
+  // Candidates per iteration placed by descending the error quadtree (see
+  // ErrorTree.hpp) instead of uniformly, sized by the node they land in. The
+  // rest keep the uniform (or weighted) placement. 0 disables.
+  int quadtreeCandidates = NUM_RECTS_PER_ITERATION / 4;
+
+  int mutations = NUM_MUTATIONS_PER_ITERATION;
+  int threads = 0; // 0 uses every hardware thread
+
+  // Candidate i of iteration n draws from random stream (n, i), so a seed
+  // reproduces a run at any thread count. 0 picks a fresh seed, stored back
+  // into the optimizer's settings. Resuming from a shape file takes the
+  // file's seed instead.
+  unsigned long long seed = 0;
+
+  // Search statistics are always tracked; the CSVs are only written when the
+  // paths are set.
+  const char* telemetryPath = nullptr;
+  const char* telemetryHistogramPath = nullptr;
+};
+
+// Everything one approximation run needs. stats points at weights and
+// histogram, so an optimizer is built in place and never copied.
+struct Optimizer {
+  OptimizerSettings settings;
+  int width = 0;
+  int height = 0;
+  int iteration = 0;
+
+  Metric metric;
+  Image original; // metric space
+  Image canvas;   // metric space
+  Image display;  // RGB version of canvas, what gets shown
+
+  WeightMap weights;
+  WeightMap roi;
+  IntegralHistogram histogram;
+  ImageStats stats;
+  SsimTracker ssim;
+  SearchTelemetry telemetry;
+  ShapeMix mix;
+
+  std::vector<ShapeType> types;
+  std::vector<Shape> shapes;
+  std::vector<float> gains;
+  std::vector<SpanBox> boxes;
+  bool batching = false;
+  bool pruning = false;
+  ErrorQuadtree errorTree;
+  RectBatch batch;
+  CandidateCache cache;
+
+  // Every shape drawn on the canvas, in order, colors in metric space: the
+  // result of the run. The last one's spans are kept too.
+  std::vector<Shape> committed;
+  Shape lastShape;
+  std::vector<Span> lastSpans;
+
+  Optimizer() = default;
+  Optimizer(const Optimizer&) = delete;
+  Optimizer& operator=(const Optimizer&) = delete;
+};
+
+// Takes a copy of original (RGB, any size) and prepares the canvas as
+// settings.init asks. A shape file that is missing or was written for another
+// size or metric leaves the canvas black, with a warning. A resumed run draws
+// the same random streams as the saved one would have; it repeats it exactly
+// only without the candidate cache and the shape mix, whose state is not
+// saved.
+void InitOptimizer(Optimizer& opt, Image original, const OptimizerSettings& settings);
+
+// Generates, scores and refines one batch of candidates and commits the best
+// one. Returns its gain.
+float StepOptimizer(Optimizer& opt);
+
+// Draws the shape on the canvas as it is, without scoring it, and appends it
+// to committed. StepOptimizer commits through here.
+void CommitShape(Optimizer& opt, const Shape& shape);
+
+// Commits the shapes in order without counting iterations, e.g. to warm
+// start from a SubdivideImage preview.
+void CommitShapes(Optimizer& opt, const std::vector<Shape>& shapes);
+
+// Writes committed to path (see ShapeFile.hpp), to resume from with
+// INIT_SHAPE_FILE. Returns false when the file cannot be written.
+bool SaveOptimizerShapes(const Optimizer& opt, const char* path);
+
+void UnloadOptimizer(Optimizer& opt);
@@ -0,0 +1,101 @@
+#include "Random.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+static std::atomic<uint64_t> runSeed{0x853C49E6748FEA9Bull};
+
+struct RandomState {
+  uint64_t s[4];
+};
+
+static uint64_t SplitMix64(uint64_t& x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static RandomState MakeState(uint64_t seed, uint64_t a, uint64_t b) {
+  // Mix the stream ids through splitmix so neighbouring streams decorrelate.
+  uint64_t x = seed;
+  x ^= SplitMix64(a);
+  x ^= SplitMix64(b) * 0xD1B54A32D192ED03ull;
+
+  RandomState st;
+  for (uint64_t& v : st.s) {
+    v = SplitMix64(x);
+  }
+  return st;
+}
+
+static thread_local RandomState state = MakeState(runSeed, 0, 0);
+
+static inline uint64_t Rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+// xoshiro256**
+static inline uint64_t Next() {
+  uint64_t* s = state.s;
+  uint64_t result = Rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = Rotl(s[3], 45);
+  return result;
+}
+
+// Unbiased value in [0, range) by multiply-and-reject (Lemire).
+static inline uint64_t Bounded(uint64_t range) {
+  __uint128_t m = (__uint128_t)Next() * range;
+  uint64_t low = (uint64_t)m;
+  if (low < range) {
+    uint64_t threshold = -range % range;
+    while (low < threshold) {
+      m = (__uint128_t)Next() * range;
+      low = (uint64_t)m;
+    }
+  }
+  return (uint64_t)(m >> 64);
+}
+
+void SeedRandom(unsigned long long seed) {
+  runSeed = seed;
+  state = MakeState(seed, 0, 0);
+}
+
+unsigned long long GetRandomSeed() {
+  return runSeed;
+}
+
+void SetRandomStream(unsigned long long a, unsigned long long b) {
+  state = MakeState(runSeed, a, b);
+}
+
+int RandInt(int min, int max) {
+  if (max <= min) {
+    return min;
+  }
+  return min + (int)Bounded((uint64_t)((long long)max - min) + 1);
+}
+
+long long RandLong(long long min, long long max) {
+  if (max <= min) {
+    return min;
+  }
+  uint64_t range = (uint64_t)max - (uint64_t)min + 1;
+  if (range == 0) {
+    return (long long)Next(); // the whole 64-bit range
+  }
+  return (long long)((uint64_t)min + Bounded(range));
+}
+
+float RandFloat(float min, float max) {
+  // 24 random bits give every float in [0, 1) a chance.
+  float u = (Next() >> 40) * (1.0f / 16777216.0f);
+  return min + u * (max - min);
+}
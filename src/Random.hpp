@@ -0,0 +1,17 @@
+#pragma once
+
+// Counter-based streams: every (a, b) pair names its own xoshiro256**
+// sequence derived from the run seed, so a draw depends only on the seed and
+// the stream, never on which thread runs it or in what order. The optimizer
+// gives each candidate the stream (iteration, index).
+
+// Sets the run seed and restarts the calling thread on stream (0, 0).
+void SeedRandom(unsigned long long seed);
+unsigned long long GetRandomSeed();
+
+// Restarts the calling thread's generator on stream (a, b).
+void SetRandomStream(unsigned long long a, unsigned long long b);
+
+int RandInt(int min, int max);
+long long RandLong(long long min, long long max);
+float RandFloat(float min, float max);
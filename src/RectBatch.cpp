@@ -0,0 +1,243 @@
+#include "RectBatch.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#include "Config.hpp"
+#include "Random.hpp"
+#include "Rects.hpp"
+#include "WeightMap.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RECT_BATCH_AVX2 1
+#endif
+
+constexpr int RANDOM_LANES = 8;
+
+// Plane order of the gathered sums: the original's, then the canvas'.
+constexpr SatPlane ORIGINAL_PLANES[] = {SAT_R, SAT_G, SAT_B, SAT_SQ, SAT_W};
+constexpr int ORIGINAL_PLANE_COUNT = 5;
+constexpr int BATCH_PLANES = ORIGINAL_PLANE_COUNT + CANVAS_SAT_PLANES;
+
+// Interleaved xoshiro256** generators, one per lane, laid out so the update
+// of all lanes compiles to vector instructions.
+struct LaneRandom {
+  uint64_t s[4][RANDOM_LANES];
+};
+
+static void SeedLanes(LaneRandom& r) {
+  for (int i = 0; i < 4; i++) {
+    for (int l = 0; l < RANDOM_LANES; l++) {
+      r.s[i][l] = (uint64_t)RandLong(LLONG_MIN, LLONG_MAX);
+    }
+  }
+}
+
+// Upper 32 bits of the next output of every lane.
+static inline void NextLanes(LaneRandom& r, uint32_t* out) {
+  for (int l = 0; l < RANDOM_LANES; l++) {
+    uint64_t s1 = r.s[1][l];
+    uint64_t x = s1 * 5;
+    x = (x << 7) | (x >> 57);
+    out[l] = (uint32_t)((x * 9) >> 32);
+
+    uint64_t t = s1 << 17;
+    r.s[2][l] ^= r.s[0][l];
+    r.s[3][l] ^= s1;
+    r.s[1][l] = s1 ^ r.s[2][l];
+    r.s[0][l] ^= r.s[3][l];
+    r.s[2][l] ^= t;
+    r.s[3][l] = (r.s[3][l] << 45) | (r.s[3][l] >> 19);
+  }
+}
+
+// Value in [0, range) by multiply-shift. The bias, at most range / 2^32, is
+// far below anything the search can notice.
+static inline int Scale(uint32_t r, uint32_t range) {
+  return (int)(((uint64_t)r * range) >> 32);
+}
+
+static void Resize(RectBatch& batch, int count) {
+  batch.count = count;
+  batch.x0.resize(count);
+  batch.y0.resize(count);
+  batch.x1.resize(count);
+  batch.y1.resize(count);
+  batch.gain.resize(count);
+  batch.color.resize(count);
+}
+
+void GenerateRectBatch(RectBatch& batch, int count, const ImageStats& stats, float iteration) {
+  Resize(batch, count);
+  int w = stats.width;
+  int h = stats.height;
+
+  if (stats.weights) {
+    // The cdf search does not vectorize; share the scalar path.
+    for (int i = 0; i < count; i++) {
+      int cx, cy;
+      Rectangle rec;
+      if (SampleWeightedPoint(*stats.weights, cx, cy)) {
+        rec = RandomRectangleAt(cx, cy, w, h, iteration);
+      } else {
+        rec = RandomRectangle(w, h, iteration);
+      }
+      batch.x0[i] = (int)rec.x;
+      batch.y0[i] = (int)rec.y;
+      batch.x1[i] = (int)rec.x + (int)rec.width;
+      batch.y1[i] = (int)rec.y + (int)rec.height;
+    }
+    return;
+  }
+
+  // Same ranges as RandomRectangle.
+  int maxSize = MaxShapeSize(iteration);
+  int sizeLimit = maxSize - MIN_END_SIZE;
+  uint32_t rangeX = (uint32_t)std::max(w - MIN_END_SIZE, 1);
+  uint32_t rangeY = (uint32_t)std::max(h - MIN_END_SIZE, 1);
+
+  LaneRandom rng;
+  SeedLanes(rng);
+  uint32_t r[4][RANDOM_LANES];
+
+  for (int base = 0; base < count; base += RANDOM_LANES) {
+    for (int k = 0; k < 4; k++) {
+      NextLanes(rng, r[k]);
+    }
+
+    int lanes = std::min(RANDOM_LANES, count - base);
+    for (int l = 0; l < lanes; l++) {
+      int x = Scale(r[0][l], rangeX);
+      int y = Scale(r[1][l], rangeY);
+      int maxW = std::min(w - x - MIN_END_SIZE, sizeLimit);
+      int maxH = std::min(h - y - MIN_END_SIZE, sizeLimit);
+      int rw = MIN_END_SIZE + Scale(r[2][l], (uint32_t)std::max(maxW - MIN_END_SIZE + 1, 1));
+      int rh = MIN_END_SIZE + Scale(r[3][l], (uint32_t)std::max(maxH - MIN_END_SIZE + 1, 1));
+
+      int i = base + l;
+      batch.x0[i] = x;
+      batch.y0[i] = y;
+      batch.x1[i] = std::min(x + rw, w);
+      batch.y1[i] = std::min(y + rh, h);
+    }
+  }
+}
+
+static void PlaneBases(const ImageStats& stats, const long long** planes) {
+  for (int p = 0; p < ORIGINAL_PLANE_COUNT; p++) {
+    planes[p] = stats.sat[ORIGINAL_PLANES[p]].data();
+  }
+  for (int p = 0; p < CANVAS_SAT_PLANES; p++) {
+    planes[ORIGINAL_PLANE_COUNT + p] = stats.canvasSat[p].data();
+  }
+}
+
+static void GatherSumsScalar(const long long* const* planes, const int* a, const int* b, const int* c, const int* d,
+                             long long (*sums)[4], int lanes) {
+  for (int p = 0; p < BATCH_PLANES; p++) {
+    const long long* s = planes[p];
+    for (int l = 0; l < lanes; l++) {
+      sums[p][l] = s[d[l]] - s[b[l]] - s[c[l]] + s[a[l]];
+    }
+  }
+}
+
+#ifdef RECT_BATCH_AVX2
+__attribute__((target("avx2")))
+static void GatherSumsAvx2(const long long* const* planes, const int* a, const int* b, const int* c, const int* d,
+                           long long (*sums)[4]) {
+  __m128i ia = _mm_loadu_si128((const __m128i*)a);
+  __m128i ib = _mm_loadu_si128((const __m128i*)b);
+  __m128i ic = _mm_loadu_si128((const __m128i*)c);
+  __m128i id = _mm_loadu_si128((const __m128i*)d);
+
+  for (int p = 0; p < BATCH_PLANES; p++) {
+    const long long* s = planes[p];
+    __m256i va = _mm256_i32gather_epi64(s, ia, 8);
+    __m256i vb = _mm256_i32gather_epi64(s, ib, 8);
+    __m256i vc = _mm256_i32gather_epi64(s, ic, 8);
+    __m256i vd = _mm256_i32gather_epi64(s, id, 8);
+    __m256i sum = _mm256_add_epi64(_mm256_sub_epi64(_mm256_sub_epi64(vd, vb), vc), va);
+    _mm256_storeu_si256((__m256i*)sums[p], sum);
+  }
+}
+
+static bool HasAvx2() {
+  static const bool has = __builtin_cpu_supports("avx2");
+  return has;
+}
+#endif
+
+void ScoreRectBatch(RectBatch& batch, const ImageStats& stats, int begin, int end) {
+  const long long* planes[BATCH_PLANES];
+  PlaneBases(stats, planes);
+  int stride = stats.width + 1;
+
+  for (int base = begin; base < end; base += 4) {
+    int lanes = std::min(4, end - base);
+    int a[4] = {}, b[4] = {}, c[4] = {}, d[4] = {};
+    for (int l = 0; l < lanes; l++) {
+      int i = base + l;
+      a[l] = batch.y0[i] * stride + batch.x0[i];
+      b[l] = batch.y0[i] * stride + batch.x1[i];
+      c[l] = batch.y1[i] * stride + batch.x0[i];
+      d[l] = batch.y1[i] * stride + batch.x1[i];
+    }
+
+    long long sums[BATCH_PLANES][4];
+#ifdef RECT_BATCH_AVX2
+    if (lanes == 4 && HasAvx2()) {
+      GatherSumsAvx2(planes, a, b, c, d, sums);
+    } else
+#endif
+    {
+      GatherSumsScalar(planes, a, b, c, d, sums, lanes);
+    }
+
+    for (int l = 0; l < lanes; l++) {
+      SpanSums s;
+      s.r = sums[0][l];
+      s.g = sums[1][l];
+      s.b = sums[2][l];
+      s.sq = sums[3][l];
+      s.n = sums[4][l];
+      s.cr = sums[ORIGINAL_PLANE_COUNT + CSAT_R][l];
+      s.cg = sums[ORIGINAL_PLANE_COUNT + CSAT_G][l];
+      s.cb = sums[ORIGINAL_PLANE_COUNT + CSAT_B][l];
+      s.csq = sums[ORIGINAL_PLANE_COUNT + CSAT_SQ][l];
+      s.cross = sums[ORIGINAL_PLANE_COUNT + CSAT_CROSS][l];
+      long long before = sums[ORIGINAL_PLANE_COUNT + CSAT_ERR][l];
+
+      int i = base + l;
+      if (s.n == 0) {
+        batch.gain[i] = -1e30f;
+        batch.color[i] = Color{0, 0, 0, 255};
+      } else {
+        batch.gain[i] = FitSpanColor(s, before, batch.color[i]);
+      }
+    }
+  }
+}
+
+int BestInRectBatch(const RectBatch& batch, int begin, int end) {
+  int best = -1;
+  for (int i = begin; i < end; i++) {
+    if (best < 0 || batch.gain[i] > batch.gain[best]) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+Shape RectBatchShape(const RectBatch& batch, int i) {
+  Shape shape{};
+  shape.type = SHAPE_RECTANGLE;
+  shape.x = (float)batch.x0[i];
+  shape.y = (float)batch.y0[i];
+  shape.width = (float)(batch.x1[i] - batch.x0[i]);
+  shape.height = (float)(batch.y1[i] - batch.y0[i]);
+  shape.c = batch.color[i];
+  return shape;
+}
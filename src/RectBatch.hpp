@@ -0,0 +1,36 @@
+#pragma once
+
+#include <vector>
+
+#include "ImageStats.hpp"
+#include "Shapes.hpp"
+
+// Rectangles generated and scored in bulk, in structure-of-arrays layout:
+// half-open integer bounds [x0, x1) x [y0, y1) per candidate. Scoring reads
+// the four corners of the original and canvas integral images per plane,
+// four candidates per AVX2 gather where the CPU supports it, so it needs
+// BuildCanvasSat to have been called on the stats.
+struct RectBatch {
+  int count = 0;
+  std::vector<int> x0, y0, x1, y1;
+  std::vector<float> gain;
+  std::vector<Color> color;
+};
+
+// Fills the batch with count rectangles from the same size schedule as
+// RandomRectangle (or centered by the weight map, when stats has one). Draws
+// from eight interleaved xoshiro256** lanes seeded off the calling thread's
+// random stream, so a batch is reproducible from that stream.
+void GenerateRectBatch(RectBatch& batch, int count, const ImageStats& stats, float iteration);
+
+// Scores candidates [begin, end): sets their color and gain exactly as
+// ScoreShape would for the same rectangle. Ranges may run on different
+// threads.
+void ScoreRectBatch(RectBatch& batch, const ImageStats& stats, int begin, int end);
+
+// Index of the highest gain in [begin, end), the lowest index on ties; -1 when
+// the range is empty.
+int BestInRectBatch(const RectBatch& batch, int begin, int end);
+
+// Candidate i as a scored SHAPE_RECTANGLE.
+Shape RectBatchShape(const RectBatch& batch, int i);
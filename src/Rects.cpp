@@ -0,0 +1,138 @@
+#include "Rects.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "Config.hpp"
+#include "Random.hpp"
+
+Color GetBestRectColor(Rectangle rec, Image original) {
+  long long rsum = 0, gsum = 0, bsum = 0, pixelcount = 0;
+
+  for (int x = rec.x; x < rec.x + rec.width; x++) {
+    for (int y = rec.y; y < rec.y + rec.height; y++) {
+      Color px = GetImageColor(original, x, y);
+      rsum += px.r;
+      gsum += px.g;
+      bsum += px.b;
+      pixelcount++;
+    }
+  }
+  if (pixelcount == 0) {
+    return Color{0, 0, 0, 255};
+  }
+
+  Color c;
+  c.r = (unsigned char)(rsum / pixelcount);
+  c.g = (unsigned char)(gsum / pixelcount);
+  c.b = (unsigned char)(bsum / pixelcount);
+  c.a = 255;
+
+  return c;
+
+}
+
+int MaxShapeSize(float iteration) {
+  float delta = iteration / MAX_ITERATIONS;
+  delta = delta*delta*delta;
+
+  int maxSize = MAX_START_SIZE * powf((float)MIN_END_SIZE / MAX_START_SIZE, delta);
+  return std::clamp(maxSize, MIN_END_SIZE+1, MAX_START_SIZE);
+}
+
+Rectangle RandomRectangle(int w, int h, float iteration) {
+  int maxSize = MaxShapeSize(iteration);
+
+  Rectangle rec;
+
+  rec.x = RandInt(0, w-MIN_END_SIZE - 1);
+  rec.y = RandInt(0, h-MIN_END_SIZE - 1);
+
+  rec.width = RandInt(MIN_END_SIZE, std::min(int(w-rec.x - MIN_END_SIZE), maxSize - MIN_END_SIZE));
+  rec.height = RandInt(MIN_END_SIZE, std::min(int(h-rec.y - MIN_END_SIZE), maxSize - MIN_END_SIZE));
+
+  return rec;
+}
+
+Rectangle RandomRectangleAt(int cx, int cy, int w, int h, float iteration) {
+  return RandomRectangleAround(cx, cy, w, h, MaxShapeSize(iteration));
+}
+
+Rectangle RandomRectangleAround(int cx, int cy, int w, int h, int maxSize) {
+  int limit = std::max(MIN_END_SIZE, maxSize - MIN_END_SIZE);
+
+  Rectangle rec;
+  rec.width = RandInt(MIN_END_SIZE, std::min(w, limit));
+  rec.height = RandInt(MIN_END_SIZE, std::min(h, limit));
+  rec.x = std::clamp(cx - (int)rec.width / 2, 0, w - (int)rec.width);
+  rec.y = std::clamp(cy - (int)rec.height / 2, 0, h - (int)rec.height);
+
+  return rec;
+}
+
+ColorRect GenerateRandomRect(int w,int h, Image original, float iteration) {
+  ColorRect crect;
+  crect.rec = RandomRectangle(w, h, iteration);
+  crect.c = GetBestRectColor(crect.rec, original);
+
+  return crect;
+}
+
+void ColorDebug(Color col) {
+  std::cout << "r: " << (int)col.r << " g: " << (int)col.g << " b: " << (int)col.b << "\n";
+}
+
+float RectangleDeltaError(ColorRect rect, Image current, Image original, bool debug) {
+  long long delta = 0;
+
+  for (int x = rect.rec.x; x < rect.rec.x + rect.rec.width; x++) {
+    for (int y = rect.rec.y; y < rect.rec.y + rect.rec.height; y++) {
+
+      Color cur = GetImageColor(current, x, y);
+      if (debug) {
+        ColorDebug(cur);
+      }
+      Color org = GetImageColor(original, x, y);
+
+      int before =
+        (cur.r - org.r) * (cur.r - org.r) +
+        (cur.g - org.g) * (cur.g - org.g )+
+        (cur.b - org.b) * (cur.b - org.b);
+
+      int after =
+        (rect.c.r - org.r) * (rect.c.r - org.r) +
+        (rect.c.g - org.g) * (rect.c.g - org.g) +
+        (rect.c.b - org.b) * (rect.c.b - org.b);
+
+      delta += before - after;
+    }
+  }
+  return (float)delta;
+}
+
+int RectangleError(ColorRect rect, Image current) {
+  int e = 0;
+  for (int x = rect.rec.x; x < rect.rec.x + rect.rec.width;x++) {
+    for (int y = rect.rec.y; y < rect.rec.y + rect.rec.height;y++) {
+      Color px = GetImageColor(current, x, y);
+      e += (px.r - rect.c.r) * (px.r - rect.c.r);
+      e += (px.g - rect.c.g) * (px.g - rect.c.g);
+      e += (px.b - rect.c.b) * (px.b - rect.c.b);
+    }
+  }
+
+  return e;
+
+}
+
+void DebugColorRect (ColorRect rec) {
+  std::cout << "x: " << rec.rec.x
+            << " y: " << rec.rec.y
+            << " w: " << rec.rec.width
+            << " h: " << rec.rec.height
+            << " r: " << (int)rec.c.r
+            << " g: " << (int)rec.c.g
+            << " b: " << (int)rec.c.b
+            << "\n";
+}
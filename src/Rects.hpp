@@ -0,0 +1,30 @@
+#pragma once
+
+#include "../include/raylib.h"
+
+struct ColorRect {
+  Rectangle rec;
+  Color c;
+};
+
+// Largest shape extent allowed at this point of the size schedule.
+int MaxShapeSize(float iteration);
+
+Rectangle RandomRectangle(int w, int h, float iteration);
+
+// Rectangle from the same size schedule, centered on (cx, cy) and kept inside
+// the image.
+Rectangle RandomRectangleAt(int cx, int cy, int w, int h, float iteration);
+
+// Same, with the largest extent given directly rather than by the schedule.
+Rectangle RandomRectangleAround(int cx, int cy, int w, int h, int maxSize);
+
+Color GetBestRectColor(Rectangle rec, Image original);
+ColorRect GenerateRandomRect(int w, int h, Image original, float iteration);
+// Unweighted; the optimizer scores through ImageStats, which applies the
+// weight map.
+float RectangleDeltaError(ColorRect rect, Image current, Image original, bool debug = false);
+int RectangleError(ColorRect rect, Image current);
+
+void ColorDebug(Color col);
+void DebugColorRect(ColorRect rec);
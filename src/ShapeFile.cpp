@@ -0,0 +1,88 @@
+#include "ShapeFile.hpp"
+
+#include <cstdio>
+
+constexpr int SHAPE_FILE_VERSION = 2;
+
+bool SaveShapes(const char* path, const ShapeFileInfo& info, const std::vector<Shape>& shapes) {
+  FILE* f = path ? fopen(path, "w") : nullptr;
+  if (!f) {
+    return false;
+  }
+
+  fprintf(f, "shapes %d %d %d %d %d %llu\n", SHAPE_FILE_VERSION, info.width, info.height, (int)info.metric,
+          info.iteration, info.seed);
+  for (const Shape& s : shapes) {
+    fprintf(f, "%d %.9g %.9g %.9g %.9g %.9g %d %d %d %d %.9g %.9g %.9g %.9g %.9g %.9g %d",
+            (int)s.type, s.x, s.y, s.width, s.height, s.angle, s.c.r, s.c.g, s.c.b, s.c.a,
+            s.gradX.x, s.gradX.y, s.gradX.z, s.gradY.x, s.gradY.y, s.gradY.z, s.pointCount);
+    for (int i = 0; i < s.pointCount; i++) {
+      fprintf(f, " %.9g %.9g", s.points[i].x, s.points[i].y);
+    }
+    fprintf(f, "\n");
+  }
+
+  bool ok = !ferror(f);
+  return fclose(f) == 0 && ok;
+}
+
+enum ReadResult {
+  READ_SHAPE,
+  READ_END,
+  READ_ERROR,
+};
+
+static ReadResult ReadShape(FILE* f, Shape& s) {
+  int type, r, g, b, a;
+  s = Shape{};
+  int fields = fscanf(f, "%d %f %f %f %f %f %d %d %d %d %f %f %f %f %f %f %d", &type, &s.x, &s.y, &s.width,
+                      &s.height, &s.angle, &r, &g, &b, &a, &s.gradX.x, &s.gradX.y, &s.gradX.z, &s.gradY.x,
+                      &s.gradY.y, &s.gradY.z, &s.pointCount);
+  if (fields == EOF) {
+    return READ_END;
+  }
+  if (fields != 17 || type < SHAPE_RECTANGLE || type > SHAPE_STROKE ||
+      s.pointCount < 0 || s.pointCount > MAX_POLYGON_POINTS) {
+    return READ_ERROR;
+  }
+
+  s.type = (ShapeType)type;
+  s.c = Color{(unsigned char)r, (unsigned char)g, (unsigned char)b, (unsigned char)a};
+  for (int i = 0; i < s.pointCount; i++) {
+    if (fscanf(f, "%f %f", &s.points[i].x, &s.points[i].y) != 2) {
+      return READ_ERROR;
+    }
+  }
+  return READ_SHAPE;
+}
+
+bool LoadShapes(const char* path, ShapeFileInfo& info, std::vector<Shape>& shapes) {
+  shapes.clear();
+  FILE* f = path ? fopen(path, "r") : nullptr;
+  if (!f) {
+    return false;
+  }
+
+  int version = 0, metric = 0;
+  bool ok = fscanf(f, "shapes %d %d %d %d %d", &version, &info.width, &info.height, &metric, &info.iteration) == 5 &&
+            version >= 1 && version <= SHAPE_FILE_VERSION;
+  info.metric = (MetricType)metric;
+  // Version 1 did not store the seed.
+  info.seed = 0;
+  if (ok && version >= 2) {
+    ok = fscanf(f, "%llu", &info.seed) == 1;
+  }
+
+  Shape s;
+  ReadResult read = READ_ERROR;
+  while (ok && (read = ReadShape(f, s)) == READ_SHAPE) {
+    shapes.push_back(s);
+  }
+  ok = ok && read == READ_END;
+  fclose(f);
+
+  if (!ok) {
+    shapes.clear();
+  }
+  return ok;
+}
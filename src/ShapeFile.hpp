@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "Metric.hpp"
+#include "Shapes.hpp"
+
+// What a shape list was made for. Colors are in the metric's space, so a list
+// only replays onto a canvas of the same size and metric.
+struct ShapeFileInfo {
+  int width = 0;
+  int height = 0;
+  MetricType metric = METRIC_RGB;
+  int iteration = 0; // search iterations run when it was written
+  unsigned long long seed = 0; // run seed, 0 when unknown
+};
+
+// Text format, a header line and then one shape per line with every field:
+//
+//   shapes 2 <width> <height> <metric> <iteration> <seed>
+//   <type> <x> <y> <width> <height> <angle> <r> <g> <b> <a>
+//     <gradX xyz> <gradY xyz> <pointCount> <x y per point>
+//
+// Floats are written with enough digits to read back exactly. Version 1
+// files, without the seed, still load with seed 0. Returns false when the
+// file cannot be written.
+bool SaveShapes(const char* path, const ShapeFileInfo& info, const std::vector<Shape>& shapes);
+
+// Returns false, leaving shapes empty, when the file is missing or malformed.
+bool LoadShapes(const char* path, ShapeFileInfo& info, std::vector<Shape>& shapes);
@@ -0,0 +1,74 @@
+#include "ShapeMix.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+constexpr float MIX_DECAY = 0.98f;
+constexpr float MIX_MIN_SHARE = 0.05f;
+
+ShapeMix CreateShapeMix(const ShapeType* types, int count) {
+  assert(count > 0);
+  ShapeMix mix;
+  mix.types.assign(types, types + count);
+  // One pseudo win in every type so the first allocation is uniform.
+  mix.wins.assign(count, 1.0f);
+  mix.trials.assign(count, 1.0f);
+  return mix;
+}
+
+void AllocateCandidates(const ShapeMix& mix, int budget, ShapeType* out) {
+  int count = (int)mix.types.size();
+  float floorShare = std::min(MIX_MIN_SHARE, 1.0f / count);
+
+  float totalRate = 0.0f;
+  for (int t = 0; t < count; t++) {
+    totalRate += mix.wins[t] / mix.trials[t];
+  }
+
+  // Largest remainder rounding of the shares to whole candidates.
+  std::vector<int> quota(count);
+  std::vector<float> remainder(count);
+  int assigned = 0;
+  for (int t = 0; t < count; t++) {
+    float rate = mix.wins[t] / mix.trials[t];
+    float share = floorShare + (1.0f - floorShare * count) * rate / totalRate;
+    float exact = share * budget;
+    quota[t] = (int)exact;
+    remainder[t] = exact - quota[t];
+    assigned += quota[t];
+  }
+  while (assigned < budget) {
+    int t = (int)(std::max_element(remainder.begin(), remainder.end()) - remainder.begin());
+    quota[t]++;
+    remainder[t] = -1.0f;
+    assigned++;
+  }
+
+  for (int i = 0; i < budget;) {
+    for (int t = 0; t < count && i < budget; t++) {
+      if (quota[t] > 0) {
+        out[i++] = mix.types[t];
+        quota[t]--;
+      }
+    }
+  }
+}
+
+void UpdateShapeMix(ShapeMix& mix, const ShapeType* tried, int count, ShapeType winner) {
+  for (size_t t = 0; t < mix.types.size(); t++) {
+    mix.wins[t] *= MIX_DECAY;
+    mix.trials[t] *= MIX_DECAY;
+    if (mix.types[t] == winner) {
+      mix.wins[t] += 1.0f;
+    }
+  }
+
+  for (int i = 0; i < count; i++) {
+    for (size_t t = 0; t < mix.types.size(); t++) {
+      if (mix.types[t] == tried[i]) {
+        mix.trials[t] += 1.0f;
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "Shapes.hpp"
+
+// Candidate budget split between shape types, bandit style: each type's share
+// follows its recent win rate per candidate, with a floor so no type stops
+// being explored.
+struct ShapeMix {
+  std::vector<ShapeType> types;
+  std::vector<float> wins;   // exponentially decayed
+  std::vector<float> trials; // exponentially decayed
+};
+
+// Needs at least one type.
+ShapeMix CreateShapeMix(const ShapeType* types, int count);
+
+// Fills out[0..budget) with the type of every candidate, interleaved so each
+// thread's chunk sees a similar mix.
+void AllocateCandidates(const ShapeMix& mix, int budget, ShapeType* out);
+
+// Records one iteration: the types that were tried and the type that won.
+void UpdateShapeMix(ShapeMix& mix, const ShapeType* tried, int count, ShapeType winner);
@@ -0,0 +1,729 @@
+#include "Shapes.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "Config.hpp"
+#include "Histogram.hpp"
+#include "Random.hpp"
+#include "Rects.hpp"
+#include "Splat.hpp"
+#include "WeightMap.hpp"
+
+constexpr bool ELLIPSE_ROTATION = true;
+constexpr int MIN_POLYGON_POINTS = 3;
+
+static float Cross(Vector2 o, Vector2 a, Vector2 b) {
+  return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// Replaces the points with their convex hull (monotone chain), returning the
+// new count. Collinear points are dropped.
+static int ConvexHull(Vector2* points, int count) {
+  std::sort(points, points + count, [](Vector2 a, Vector2 b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+  });
+
+  Vector2 hull[2 * MAX_POLYGON_POINTS];
+  int k = 0;
+  for (int i = 0; i < count; i++) {
+    while (k >= 2 && Cross(hull[k - 2], hull[k - 1], points[i]) <= 0.0f) k--;
+    hull[k++] = points[i];
+  }
+  for (int i = count - 2, lower = k + 1; i >= 0; i--) {
+    while (k >= lower && Cross(hull[k - 2], hull[k - 1], points[i]) <= 0.0f) k--;
+    hull[k++] = points[i];
+  }
+
+  k = std::max(k - 1, 0);
+  std::copy(hull, hull + k, points);
+  return k;
+}
+
+static bool IsConvex(const Vector2* points, int count) {
+  for (int i = 0; i < count; i++) {
+    if (Cross(points[i], points[(i + 1) % count], points[(i + 2) % count]) <= 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Uniform over the image, or proportional to importance with a weight map.
+static void RandomCenter(const ImageStats& stats, float& x, float& y) {
+  int px, py;
+  if (stats.weights && SampleWeightedPoint(*stats.weights, px, py)) {
+    x = px;
+    y = py;
+    return;
+  }
+  x = RandInt(0, stats.width - 1);
+  y = RandInt(0, stats.height - 1);
+}
+
+static void GenerateRandomPolygon(Shape& shape, int count, float cx, float cy, int maxRadius) {
+  // Vertices scattered around the center, then hulled; retry the rare
+  // degenerate draw where every point ends up collinear.
+  do {
+    for (int i = 0; i < count; i++) {
+      shape.points[i].x = cx + RandInt(-maxRadius, maxRadius);
+      shape.points[i].y = cy + RandInt(-maxRadius, maxRadius);
+    }
+    shape.pointCount = ConvexHull(shape.points, count);
+  } while (shape.pointCount < MIN_POLYGON_POINTS);
+}
+
+static Shape RectangleShape(ShapeType type, Rectangle rec) {
+  Shape shape{};
+  shape.type = type;
+  shape.c = Color{0, 0, 0, 255};
+  shape.x = rec.x;
+  shape.y = rec.y;
+  shape.width = rec.width;
+  shape.height = rec.height;
+  return shape;
+}
+
+Shape GenerateRandomShape(ShapeType type, const ImageStats& stats, float iteration) {
+  if ((type == SHAPE_RECTANGLE || type == SHAPE_GRADIENT_RECTANGLE) && !stats.weights) {
+    return RectangleShape(type, RandomRectangle(stats.width, stats.height, iteration));
+  }
+
+  float cx, cy;
+  RandomCenter(stats, cx, cy);
+  return GenerateShapeAt(type, stats, cx, cy, MaxShapeSize(iteration));
+}
+
+Shape GenerateShapeAt(ShapeType type, const ImageStats& stats, float cx, float cy, int maxSize) {
+  if (type == SHAPE_RECTANGLE || type == SHAPE_GRADIENT_RECTANGLE) {
+    return RectangleShape(type, RandomRectangleAround(cx, cy, stats.width, stats.height, maxSize));
+  }
+
+  Shape shape{};
+  shape.type = type;
+  shape.c = Color{0, 0, 0, 255};
+
+  int maxRadius = std::max(MIN_END_SIZE, maxSize / 2);
+
+  if (type == SHAPE_STROKE) {
+    float length = RandInt(MIN_END_SIZE, 2 * maxRadius);
+    float angle = RandFloat(0.0f, 2.0f * PI);
+    shape.points[0] = Vector2{roundf(cx - 0.5f * length * cosf(angle)), roundf(cy - 0.5f * length * sinf(angle))};
+    shape.points[1] = Vector2{roundf(cx + 0.5f * length * cosf(angle)), roundf(cy + 0.5f * length * sinf(angle))};
+    shape.pointCount = 2;
+    shape.width = RandInt(1, std::max(1, maxRadius / 4));
+    return shape;
+  }
+
+  if (type == SHAPE_TRIANGLE || type == SHAPE_POLYGON) {
+    int count = type == SHAPE_TRIANGLE ? 3 : RandInt(MIN_POLYGON_POINTS, MAX_POLYGON_POINTS);
+    GenerateRandomPolygon(shape, count, cx, cy, maxRadius);
+    return shape;
+  }
+
+  shape.x = cx;
+  shape.y = cy;
+  shape.width = RandInt(MIN_END_SIZE, maxRadius);
+
+  if (type == SHAPE_ELLIPSE) {
+    shape.height = RandInt(MIN_END_SIZE, maxRadius);
+    shape.angle = ELLIPSE_ROTATION ? RandFloat(0.0f, PI) : 0.0f;
+  }
+
+  if (type == SHAPE_ROTATED_RECTANGLE) {
+    shape.height = RandInt(MIN_END_SIZE, maxRadius);
+    shape.angle = RandFloat(0.0f, PI);
+  }
+
+  if (type == SHAPE_SPLAT) {
+    float maxSigma = std::max(1.0f, maxRadius / SPLAT_SIGMAS);
+    shape.width = RandFloat(0.5f, maxSigma);
+    shape.height = RandFloat(0.5f, maxSigma);
+    shape.angle = RandFloat(0.0f, PI);
+  }
+
+  return shape;
+}
+
+static void PushSpan(std::vector<Span>& spans, int y, int x0, int x1, int w, int h) {
+  if (y < 0 || y >= h) return;
+  x0 = std::max(x0, 0);
+  x1 = std::min(x1, w);
+  if (x0 < x1) {
+    spans.push_back(Span{y, x0, x1});
+  }
+}
+
+static void RasterizeRectangle(const Shape& shape, int w, int h, std::vector<Span>& spans) {
+  int x0 = shape.x;
+  int y0 = shape.y;
+  for (int y = y0; y < y0 + (int)shape.height; y++) {
+    PushSpan(spans, y, x0, x0 + (int)shape.width, w, h);
+  }
+}
+
+// Same midpoint walk as ImageDrawCircle, folded into one integer half-width
+// per row so the spans cover exactly the pixels it would draw (including the
+// single pixel ImageDrawRectangle leaves for zero-width rows).
+static void RasterizeCircle(const Shape& shape, int w, int h, std::vector<Span>& spans) {
+  int cx = shape.x;
+  int cy = shape.y;
+  int radius = shape.width;
+
+  thread_local std::vector<int> halfWidths;
+  halfWidths.assign(radius + 1, 0);
+
+  int x = 0;
+  int y = radius;
+  int decesionParameter = 3 - 2*radius;
+
+  while (y >= x) {
+    halfWidths[y] = std::max(halfWidths[y], x);
+    halfWidths[x] = std::max(halfWidths[x], y);
+    x++;
+
+    if (decesionParameter > 0) {
+      y--;
+      decesionParameter = decesionParameter + 4*(x - y) + 10;
+    }
+    else decesionParameter = decesionParameter + 4*x + 6;
+  }
+
+  for (int dy = -radius; dy <= radius; dy++) {
+    int hw = halfWidths[std::abs(dy)];
+    PushSpan(spans, cy + dy, cx - hw, cx + std::max(hw, 1), w, h);
+  }
+}
+
+static void RasterizeEllipse(const Shape& shape, int w, int h, std::vector<Span>& spans) {
+  float a = shape.width;
+  float b = shape.height;
+  int cx = shape.x;
+  int cy = shape.y;
+
+  if (shape.angle == 0.0f) {
+    // Axis aligned: symmetric, so one integer half-width per |dy|.
+    int rows = (int)b;
+    for (int dy = -rows; dy <= rows; dy++) {
+      float t = 1.0f - (float)(dy * dy) / (b * b);
+      int hw = (int)(a * sqrtf(std::max(t, 0.0f)));
+      PushSpan(spans, cy + dy, cx - hw, cx + hw + 1, w, h);
+    }
+    return;
+  }
+
+  // Points with (dx*cos + dy*sin)^2/a^2 + (dy*cos - dx*sin)^2/b^2 <= 1 form
+  // A*dx^2 + B*dx + C <= 0 on each row.
+  float cs = cosf(shape.angle);
+  float sn = sinf(shape.angle);
+  float ia = 1.0f / (a * a);
+  float ib = 1.0f / (b * b);
+  float A = cs * cs * ia + sn * sn * ib;
+  float Bk = 2.0f * sn * cs * (ia - ib);
+  float Ck = sn * sn * ia + cs * cs * ib;
+
+  int rows = (int)sqrtf(a * a * sn * sn + b * b * cs * cs);
+  for (int dy = -rows; dy <= rows; dy++) {
+    float B = Bk * dy;
+    float C = Ck * dy * dy - 1.0f;
+    float disc = B * B - 4.0f * A * C;
+    if (disc < 0.0f) continue;
+
+    float mid = -B / (2.0f * A);
+    float half = sqrtf(disc) / (2.0f * A);
+    int x0 = (int)ceilf(mid - half);
+    int x1 = (int)floorf(mid + half) + 1;
+    PushSpan(spans, cy + dy, cx + x0, cx + x1, w, h);
+  }
+}
+
+// Scanline fill of a convex polygon, shared by triangles, polygons and
+// rotated rectangles: pixel (x, y) is covered when the point (x, y) lies
+// inside it, so each row holds a single span.
+static void RasterizeConvex(const Vector2* points, int count, int w, int h, std::vector<Span>& spans) {
+  float minY = points[0].y;
+  float maxY = points[0].y;
+  for (int i = 1; i < count; i++) {
+    minY = std::min(minY, points[i].y);
+    maxY = std::max(maxY, points[i].y);
+  }
+
+  int y0 = std::max((int)ceilf(minY), 0);
+  int y1 = std::min((int)floorf(maxY), h - 1);
+
+  for (int y = y0; y <= y1; y++) {
+    float left = 1e30f;
+    float right = -1e30f;
+
+    for (int i = 0; i < count; i++) {
+      Vector2 a = points[i];
+      Vector2 b = points[(i + 1) % count];
+      if ((y < a.y && y < b.y) || (y > a.y && y > b.y)) continue;
+
+      if (a.y == b.y) {
+        left = std::min(left, std::min(a.x, b.x));
+        right = std::max(right, std::max(a.x, b.x));
+        continue;
+      }
+
+      float x = a.x + (b.x - a.x) * (y - a.y) / (b.y - a.y);
+      left = std::min(left, x);
+      right = std::max(right, x);
+    }
+
+    if (left <= right) {
+      PushSpan(spans, y, (int)ceilf(left), (int)floorf(right) + 1, w, h);
+    }
+  }
+}
+
+static void RasterizeRotatedRectangle(const Shape& shape, int w, int h, std::vector<Span>& spans) {
+  float cs = cosf(shape.angle);
+  float sn = sinf(shape.angle);
+  float hx = shape.width;
+  float hy = shape.height;
+
+  Vector2 corners[4] = {
+    {shape.x - hx * cs + hy * sn, shape.y - hx * sn - hy * cs},
+    {shape.x + hx * cs + hy * sn, shape.y + hx * sn - hy * cs},
+    {shape.x + hx * cs - hy * sn, shape.y + hx * sn + hy * cs},
+    {shape.x - hx * cs - hy * sn, shape.y - hx * sn + hy * cs},
+  };
+
+  RasterizeConvex(corners, 4, w, h, spans);
+}
+
+// Thick line from an integer DDA (Bresenham) walk of the center line. The
+// thickness is applied along the minor axis, widened by length / major so the
+// perpendicular width matches shape.width.
+static void RasterizeStroke(const Shape& shape, int w, int h, std::vector<Span>& spans) {
+  int x0 = (int)lroundf(shape.points[0].x);
+  int y0 = (int)lroundf(shape.points[0].y);
+  int x1 = (int)lroundf(shape.points[1].x);
+  int y1 = (int)lroundf(shape.points[1].y);
+
+  int dx = std::abs(x1 - x0);
+  int dy = std::abs(y1 - y0);
+  int major = std::max(dx, dy);
+  float stretch = major > 0 ? sqrtf((float)(dx * dx + dy * dy)) / major : 1.0f;
+  int half = std::max(0, (int)lroundf((shape.width * stretch - 1.0f) * 0.5f));
+
+  if (dy > dx) {
+    // Steep: one center x per row, thickened horizontally.
+    if (y0 > y1) {
+      std::swap(x0, x1);
+      std::swap(y0, y1);
+    }
+    int sx = x0 < x1 ? 1 : -1;
+    int err = dy / 2;
+    int x = x0;
+    for (int y = y0; y <= y1; y++) {
+      PushSpan(spans, y, x - half, x + half + 1, w, h);
+      err -= dx;
+      if (err < 0) {
+        x += sx;
+        err += dy;
+      }
+    }
+    return;
+  }
+
+  // Shallow: record the run of center x on each row, then every stroke row
+  // spans the runs of the center rows within half of it. The runs move
+  // monotonically, so only the two outermost rows matter.
+  if (x0 > x1) {
+    std::swap(x0, x1);
+    std::swap(y0, y1);
+  }
+  int top = std::min(y0, y1);
+  int bottom = std::max(y0, y1);
+
+  thread_local std::vector<int> firstX, lastX;
+  firstX.assign(bottom - top + 1, 1 << 30);
+  lastX.assign(bottom - top + 1, -(1 << 30));
+
+  int sy = y0 < y1 ? 1 : -1;
+  int err = dx / 2;
+  int y = y0;
+  for (int x = x0; x <= x1; x++) {
+    firstX[y - top] = std::min(firstX[y - top], x);
+    lastX[y - top] = std::max(lastX[y - top], x);
+    err -= dy;
+    if (err < 0) {
+      y += sy;
+      err += dx;
+    }
+  }
+
+  for (int row = top - half; row <= bottom + half; row++) {
+    int lo = std::max(row - half, top) - top;
+    int hi = std::min(row + half, bottom) - top;
+    PushSpan(spans, row, std::min(firstX[lo], firstX[hi]), std::max(lastX[lo], lastX[hi]) + 1, w, h);
+  }
+}
+
+void RasterizeShape(const Shape& shape, int w, int h, std::vector<Span>& spans) {
+  spans.clear();
+
+  switch (shape.type) {
+    case SHAPE_RECTANGLE:
+    case SHAPE_GRADIENT_RECTANGLE: RasterizeRectangle(shape, w, h, spans); break;
+    case SHAPE_CIRCLE: RasterizeCircle(shape, w, h, spans); break;
+    case SHAPE_ELLIPSE: RasterizeEllipse(shape, w, h, spans); break;
+    case SHAPE_ROTATED_RECTANGLE: RasterizeRotatedRectangle(shape, w, h, spans); break;
+    case SHAPE_TRIANGLE:
+    case SHAPE_POLYGON: RasterizeConvex(shape.points, shape.pointCount, w, h, spans); break;
+    case SHAPE_SPLAT: RasterizeSplat(shape, w, h, spans); break;
+    case SHAPE_STROKE: RasterizeStroke(shape, w, h, spans); break;
+  }
+}
+
+// Center plus or minus the extents, padded a pixel for the rounding the
+// rasterizers do.
+static SpanBox CenteredBounds(float cx, float cy, float ex, float ey) {
+  return SpanBox{(int)floorf(cx - ex) - 1, (int)floorf(cy - ey) - 1,
+                 (int)floorf(cx + ex) + 2, (int)floorf(cy + ey) + 2};
+}
+
+SpanBox ShapeBounds(const Shape& shape, int w, int h) {
+  SpanBox box;
+  float cs = cosf(shape.angle);
+  float sn = sinf(shape.angle);
+
+  switch (shape.type) {
+    case SHAPE_RECTANGLE:
+    case SHAPE_GRADIENT_RECTANGLE:
+      box.x0 = (int)shape.x;
+      box.y0 = (int)shape.y;
+      box.x1 = box.x0 + (int)shape.width;
+      box.y1 = box.y0 + (int)shape.height;
+      break;
+    case SHAPE_CIRCLE: {
+      int cx = shape.x;
+      int cy = shape.y;
+      int r = std::max((int)shape.width, 1);
+      box = SpanBox{cx - r, cy - r, cx + r + 1, cy + r + 1};
+      break;
+    }
+    case SHAPE_ELLIPSE:
+      box = CenteredBounds((int)shape.x, (int)shape.y,
+                           sqrtf(shape.width * shape.width * cs * cs + shape.height * shape.height * sn * sn),
+                           sqrtf(shape.width * shape.width * sn * sn + shape.height * shape.height * cs * cs));
+      break;
+    case SHAPE_ROTATED_RECTANGLE:
+      box = CenteredBounds(shape.x, shape.y,
+                           shape.width * fabsf(cs) + shape.height * fabsf(sn),
+                           shape.width * fabsf(sn) + shape.height * fabsf(cs));
+      break;
+    case SHAPE_SPLAT:
+      box = CenteredBounds(shape.x, shape.y,
+                           SPLAT_SIGMAS * sqrtf(shape.width * shape.width * cs * cs + shape.height * shape.height * sn * sn),
+                           SPLAT_SIGMAS * sqrtf(shape.width * shape.width * sn * sn + shape.height * shape.height * cs * cs));
+      break;
+    case SHAPE_TRIANGLE:
+    case SHAPE_POLYGON: {
+      float minX = shape.points[0].x, maxX = minX;
+      float minY = shape.points[0].y, maxY = minY;
+      for (int i = 1; i < shape.pointCount; i++) {
+        minX = std::min(minX, shape.points[i].x);
+        maxX = std::max(maxX, shape.points[i].x);
+        minY = std::min(minY, shape.points[i].y);
+        maxY = std::max(maxY, shape.points[i].y);
+      }
+      box = CenteredBounds((minX + maxX) * 0.5f, (minY + maxY) * 0.5f, (maxX - minX) * 0.5f, (maxY - minY) * 0.5f);
+      break;
+    }
+    case SHAPE_STROKE: {
+      // Same rounding as RasterizeStroke; the stretch is at most sqrt(2).
+      int x0 = (int)lroundf(shape.points[0].x);
+      int y0 = (int)lroundf(shape.points[0].y);
+      int x1 = (int)lroundf(shape.points[1].x);
+      int y1 = (int)lroundf(shape.points[1].y);
+      int half = (int)ceilf(shape.width * 0.75f) + 1;
+      box = SpanBox{std::min(x0, x1) - half, std::min(y0, y1) - half,
+                    std::max(x0, x1) + half + 1, std::max(y0, y1) + half + 1};
+      break;
+    }
+  }
+
+  box.x0 = std::max(box.x0, 0);
+  box.y0 = std::max(box.y0, 0);
+  box.x1 = std::min(box.x1, w);
+  box.y1 = std::min(box.y1, h);
+  return box;
+}
+
+// Solves the symmetric system m * x = rhs (n <= 3) by Gaussian elimination.
+static void SolveSmall(double m[3][3], double rhs[3], int n, double out[3]) {
+  for (int col = 0; col < n; col++) {
+    for (int row = col + 1; row < n; row++) {
+      double f = m[row][col] / m[col][col];
+      for (int k = col; k < n; k++) {
+        m[row][k] -= f * m[col][k];
+      }
+      rhs[row] -= f * rhs[col];
+    }
+  }
+  for (int row = n - 1; row >= 0; row--) {
+    double v = rhs[row];
+    for (int k = row + 1; k < n; k++) {
+      v -= m[row][k] * out[k];
+    }
+    out[row] = v / m[row][row];
+  }
+}
+
+// Weighted least-squares plane c + gradX*u + gradY*v per channel over the
+// rectangle, with u, v measured from its center. Every moment of the normal
+// equations comes from the integral images, so the fit is O(1); a direction
+// with no spread (one-pixel-wide rectangles) drops out of the system.
+static float ScoreGradientRectangle(Shape& shape, const ImageStats& stats, const std::vector<Span>& spans) {
+  int x0 = spans.front().x0;
+  int x1 = spans.front().x1;
+  int y0 = spans.front().y;
+  int y1 = spans.back().y + 1;
+
+  double sw = SatSum(stats, SAT_W, x0, y0, x1, y1);
+  if (sw <= 0.0) {
+    return -1e30f;
+  }
+
+  double cu = (x0 + x1 - 1) * 0.5;
+  double cv = (y0 + y1 - 1) * 0.5;
+  double swx = SatSum(stats, SAT_WX, x0, y0, x1, y1);
+  double swy = SatSum(stats, SAT_WY, x0, y0, x1, y1);
+  double su = swx - cu * sw;
+  double sv = swy - cv * sw;
+  double suu = SatSum(stats, SAT_WXX, x0, y0, x1, y1) - 2.0 * cu * swx + cu * cu * sw;
+  double svv = SatSum(stats, SAT_WYY, x0, y0, x1, y1) - 2.0 * cv * swy + cv * cv * sw;
+  double suv = SatSum(stats, SAT_WXY, x0, y0, x1, y1) - cu * swy - cv * swx + cu * cv * sw;
+
+  // Terms of the plane in use: constant, then u and v if they vary.
+  int terms[3] = {0};
+  int n = 1;
+  if (suu > 1e-3 * sw) terms[n++] = 1;
+  if (svv > 1e-3 * sw) terms[n++] = 2;
+
+  double moments[3][3] = {
+    {sw, su, sv},
+    {su, suu, suv},
+    {sv, suv, svv},
+  };
+
+  double explained = 0.0;
+  float coef[3][3] = {};
+  for (int ch = 0; ch < 3; ch++) {
+    double s = SatSum(stats, (SatPlane)(SAT_R + ch), x0, y0, x1, y1);
+    double full[3] = {
+      s,
+      SatSum(stats, (SatPlane)(SAT_XR + ch), x0, y0, x1, y1) - cu * s,
+      SatSum(stats, (SatPlane)(SAT_YR + ch), x0, y0, x1, y1) - cv * s,
+    };
+
+    double m[3][3], rhs[3], beta[3];
+    for (int i = 0; i < n; i++) {
+      rhs[i] = full[terms[i]];
+      for (int j = 0; j < n; j++) {
+        m[i][j] = moments[terms[i]][terms[j]];
+      }
+    }
+    SolveSmall(m, rhs, n, beta);
+
+    // Residual of a least-squares fit: sum(w*I^2) - beta . X^T W I.
+    for (int i = 0; i < n; i++) {
+      explained += beta[i] * full[terms[i]];
+      coef[ch][terms[i]] = (float)beta[i];
+    }
+  }
+
+  shape.c = Color{
+    (unsigned char)std::clamp(std::lround(coef[0][0]), 0L, 255L),
+    (unsigned char)std::clamp(std::lround(coef[1][0]), 0L, 255L),
+    (unsigned char)std::clamp(std::lround(coef[2][0]), 0L, 255L),
+    255,
+  };
+  shape.gradX = Vector3{coef[0][1], coef[1][1], coef[2][1]};
+  shape.gradY = Vector3{coef[0][2], coef[1][2], coef[2][2]};
+
+  double after = SatSum(stats, SAT_SQ, x0, y0, x1, y1) - explained;
+  return (float)(SumSpansError(stats, spans) - after);
+}
+
+// Robust mode: median color and L1 gain from the integral histograms, in
+// O(bins) per candidate.
+static float ScoreRectangleRobust(Shape& shape, const ImageStats& stats, const std::vector<Span>& spans) {
+  int x0 = spans.front().x0;
+  int x1 = spans.front().x1;
+  int y0 = spans.front().y;
+  int y1 = spans.back().y + 1;
+
+  int counts[HISTOGRAM_PLANES];
+  GetRectHistogram(*stats.histogram, x0, y0, x1, y1, counts);
+
+  shape.c = GetHistogramMedianColor(counts, (x1 - x0) * (y1 - y0));
+  return (float)(SumSpansErrorL1(stats, spans) - HistogramL1Error(counts, shape.c));
+}
+
+float ScoreShape(Shape& shape, const ImageStats& stats, std::vector<Span>& spans) {
+  RasterizeShape(shape, stats.width, stats.height, spans);
+
+  if (shape.type == SHAPE_RECTANGLE && stats.histogram) {
+    return spans.empty() ? -1e30f : ScoreRectangleRobust(shape, stats, spans);
+  }
+
+  if (shape.type == SHAPE_GRADIENT_RECTANGLE) {
+    return spans.empty() ? -1e30f : ScoreGradientRectangle(shape, stats, spans);
+  }
+  if (shape.type == SHAPE_SPLAT) {
+    return ScoreSplat(shape, stats, spans);
+  }
+
+  SpanSums sums = SumSpans(stats, spans);
+  if (sums.n == 0) {
+    return -1e30f;
+  }
+
+  long long before = SumSpansError(stats, spans);
+  return FitSpanColor(sums, before, shape.c);
+}
+
+void DrawShape(Image* dst, const Shape& shape, const std::vector<Span>& spans) {
+  if (shape.type == SHAPE_SPLAT) {
+    DrawSplat(dst, shape, spans);
+    return;
+  }
+  if (shape.type != SHAPE_GRADIENT_RECTANGLE || spans.empty()) {
+    DrawSpans(dst, spans, shape.c);
+    return;
+  }
+
+  // Same clipped center the fit used; spans may have been trimmed further.
+  int x0 = std::max((int)shape.x, 0);
+  int y0 = std::max((int)shape.y, 0);
+  int x1 = std::min((int)shape.x + (int)shape.width, dst->width);
+  int y1 = std::min((int)shape.y + (int)shape.height, dst->height);
+
+  Color* px = (Color*)dst->data;
+  float cu = (x0 + x1 - 1) * 0.5f;
+  float cv = (y0 + y1 - 1) * 0.5f;
+  float base[3] = {(float)shape.c.r, (float)shape.c.g, (float)shape.c.b};
+  float gx[3] = {shape.gradX.x, shape.gradX.y, shape.gradX.z};
+  float gy[3] = {shape.gradY.x, shape.gradY.y, shape.gradY.z};
+
+  for (const Span& s : spans) {
+    Color* row = px + s.y * dst->width;
+    for (int x = s.x0; x < s.x1; x++) {
+      unsigned char out[3];
+      for (int ch = 0; ch < 3; ch++) {
+        float v = base[ch] + gx[ch] * (x - cu) + gy[ch] * (s.y - cv);
+        out[ch] = (unsigned char)std::clamp(std::lround(v), 0L, 255L);
+      }
+      row[x] = Color{out[0], out[1], out[2], 255};
+    }
+  }
+}
+
+// Moves one vertex, or the whole polygon, keeping it convex.
+static void MutatePolygon(Shape& shape, int w, int h, int step) {
+  int count = shape.pointCount;
+  int vertex = RandInt(0, count);
+  float dx = RandInt(-step, step);
+  float dy = RandInt(-step, step);
+
+  if (vertex == count) {
+    for (int i = 0; i < count; i++) {
+      shape.points[i].x += dx;
+      shape.points[i].y += dy;
+    }
+    return;
+  }
+
+  Vector2 old = shape.points[vertex];
+  shape.points[vertex].x = std::clamp(old.x + dx, 0.0f, (float)(w - 1));
+  shape.points[vertex].y = std::clamp(old.y + dy, 0.0f, (float)(h - 1));
+
+  if (!IsConvex(shape.points, count)) {
+    shape.points[vertex] = old;
+  }
+}
+
+// Moves one endpoint, the whole stroke, or changes its thickness.
+static void MutateStroke(Shape& shape, int w, int h, int step) {
+  int param = RandInt(0, 3);
+  float dx = RandInt(-step, step);
+  float dy = RandInt(-step, step);
+
+  if (param == 3) {
+    shape.width = std::max(shape.width + RandInt(-step, step), 1.0f);
+    return;
+  }
+
+  for (int i = 0; i < 2; i++) {
+    if (param == i || param == 2) {
+      shape.points[i].x = std::clamp(shape.points[i].x + dx, 0.0f, (float)(w - 1));
+      shape.points[i].y = std::clamp(shape.points[i].y + dy, 0.0f, (float)(h - 1));
+    }
+  }
+}
+
+void MutateShape(Shape& shape, int w, int h, float iteration) {
+  int step = std::max(1, MaxShapeSize(iteration) / 8);
+  float minSize = MIN_END_SIZE;
+
+  if (shape.type == SHAPE_TRIANGLE || shape.type == SHAPE_POLYGON) {
+    MutatePolygon(shape, w, h, step);
+    return;
+  }
+  if (shape.type == SHAPE_STROKE) {
+    MutateStroke(shape, w, h, step);
+    return;
+  }
+
+  int param = RandInt(0, shape.type == SHAPE_CIRCLE ? 2 : 4);
+  switch (param) {
+    case 0: shape.x = std::clamp(shape.x + RandInt(-step, step), 0.0f, (float)(w - 1)); break;
+    case 1: shape.y = std::clamp(shape.y + RandInt(-step, step), 0.0f, (float)(h - 1)); break;
+    case 2: shape.width = std::max(shape.width + RandInt(-step, step), minSize); break;
+    case 3: shape.height = std::max(shape.height + RandInt(-step, step), minSize); break;
+    case 4:
+      if (shape.type == SHAPE_RECTANGLE || shape.type == SHAPE_GRADIENT_RECTANGLE) {
+        shape.width = std::max(shape.width + RandInt(-step, step), minSize);
+        shape.height = std::max(shape.height + RandInt(-step, step), minSize);
+      } else {
+        shape.angle += RandFloat(-0.25f, 0.25f);
+      }
+      break;
+  }
+}
+
+float RefineShape(Shape& shape, float gain, const ImageStats& stats, int mutations, float iteration, std::vector<Span>& spans) {
+  for (int i = 0; i < mutations; i++) {
+    Shape candidate = shape;
+    MutateShape(candidate, stats.width, stats.height, iteration);
+
+    float d = ScoreShape(candidate, stats, spans);
+    if (d > gain) {
+      gain = d;
+      shape = candidate;
+    }
+  }
+
+  return gain;
+}
+
+void DebugShape(const Shape& shape) {
+  std::cout << "type: " << (int)shape.type
+            << " x: " << shape.x
+            << " y: " << shape.y
+            << " w: " << shape.width
+            << " h: " << shape.height
+            << " angle: " << shape.angle
+            << " r: " << (int)shape.c.r
+            << " g: " << (int)shape.c.g
+            << " b: " << (int)shape.c.b;
+  for (int i = 0; i < shape.pointCount; i++) {
+    std::cout << " p" << i << "=(" << shape.points[i].x << ", " << shape.points[i].y << ")";
+  }
+  std::cout << "\n";
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+#include "../include/raylib.h"
+#include "ImageStats.hpp"
+
+enum ShapeType {
+  SHAPE_RECTANGLE = 0,
+  SHAPE_CIRCLE,
+  SHAPE_ELLIPSE,
+  SHAPE_ROTATED_RECTANGLE,
+  SHAPE_GRADIENT_RECTANGLE,
+  SHAPE_TRIANGLE,
+  SHAPE_POLYGON,
+  SHAPE_SPLAT,
+  SHAPE_STROKE,
+};
+
+constexpr int MAX_POLYGON_POINTS = 8;
+
+struct Shape {
+  ShapeType type;
+  // Rectangles: top-left corner and size.
+  // Circles: center, radius in width.
+  // Ellipses: center, semi-axes in width/height, rotation in angle (radians).
+  // Rotated rectangles: center, half-extents in width/height, angle (radians).
+  // Gradient rectangles: as rectangles, with c the color at the center and
+  // gradX/gradY the per-channel slope along x and y.
+  // Splats: center, standard deviations in width/height, angle (radians) and
+  // peak opacity in c.a.
+  // Triangles and polygons: pointCount convex vertices in counter-clockwise
+  // order (3 for triangles, up to MAX_POLYGON_POINTS otherwise).
+  // Strokes: endpoints in points[0] and points[1], thickness in width.
+  float x, y;
+  float width, height;
+  float angle;
+  Color c;
+  Vector3 gradX, gradY;
+  Vector2 points[MAX_POLYGON_POINTS];
+  int pointCount;
+};
+
+// Placement follows stats.weights when set, uniform otherwise.
+Shape GenerateRandomShape(ShapeType type, const ImageStats& stats, float iteration);
+
+// Candidate centered on (cx, cy), at most maxSize across; the rest of the
+// parameters are random.
+Shape GenerateShapeAt(ShapeType type, const ImageStats& stats, float cx, float cy, int maxSize);
+
+// Clears spans and fills them with the shape's coverage clipped to w x h.
+void RasterizeShape(const Shape& shape, int w, int h, std::vector<Span>& spans);
+
+// Box holding every pixel RasterizeShape would cover, clipped to w x h, from
+// the shape's parameters alone. Can be a little loose; empty when x1 <= x0.
+SpanBox ShapeBounds(const Shape& shape, int w, int h);
+
+// Rasterizes the shape, sets its color (and alpha, when blending is enabled)
+// to the best fit for the area it covers and returns the error it would
+// remove from the canvas. Rectangles switch to median colors and L1 error when
+// stats carries an integral histogram.
+float ScoreShape(Shape& shape, const ImageStats& stats, std::vector<Span>& spans);
+
+// Paints the shape's spans (as produced by RasterizeShape, possibly trimmed
+// by ClipSpansToMask) into dst.
+void DrawShape(Image* dst, const Shape& shape, const std::vector<Span>& spans);
+
+// Nudges one parameter of the shape, scaled to the current size schedule.
+void MutateShape(Shape& shape, int w, int h, float iteration);
+
+// Hill climbs the shape through random mutations, keeping any that raise its
+// gain. Returns the final gain.
+float RefineShape(Shape& shape, float gain, const ImageStats& stats, int mutations, float iteration, std::vector<Span>& spans);
+
+void DebugShape(const Shape& shape);
@@ -0,0 +1,187 @@
+#include "Splat.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Config.hpp"
+#include "WeightMap.hpp"
+
+// Inverse covariance of the splat: exponent = (A*dx^2 + 2*B*dx*dy + C*dy^2) / 2.
+struct SplatForm {
+  float A, B, C;
+};
+
+static SplatForm GetSplatForm(const Shape& shape) {
+  float cs = cosf(shape.angle);
+  float sn = sinf(shape.angle);
+  float ia = 1.0f / (shape.width * shape.width);
+  float ib = 1.0f / (shape.height * shape.height);
+
+  return SplatForm{
+    cs * cs * ia + sn * sn * ib,
+    sn * cs * (ia - ib),
+    sn * sn * ia + cs * cs * ib,
+  };
+}
+
+// Fills weights for x in [span.x0, span.x1). Completing the square splits the
+// exponent into a row factor times a 1D Gaussian in x centered at cx + m, and
+// consecutive ratios of a Gaussian are geometric, so a row costs three exp()
+// calls and a multiply per pixel.
+static void SplatRowWeights(const Shape& shape, const SplatForm& f, const Span& span, float* weights) {
+  float dy = span.y - shape.y;
+  float m = -f.B * dy / f.A;
+  float rowFactor = expf(-0.5f * (f.C - f.B * f.B / f.A) * dy * dy);
+
+  float t = span.x0 - shape.x - m;
+  float weight = rowFactor * expf(-0.5f * f.A * t * t);
+  float ratio = expf(-0.5f * f.A * (2.0f * t + 1.0f));
+  float q = expf(-f.A);
+
+  for (int x = span.x0; x < span.x1; x++) {
+    weights[x - span.x0] = weight;
+    weight *= ratio;
+    ratio *= q;
+  }
+}
+
+void RasterizeSplat(const Shape& shape, int w, int h, std::vector<Span>& spans) {
+  SplatForm f = GetSplatForm(shape);
+  float limit = SPLAT_SIGMAS * SPLAT_SIGMAS;
+  float rowCoef = f.C - f.B * f.B / f.A;
+
+  int rows = (int)(SPLAT_SIGMAS * sqrtf(shape.width * shape.width * sinf(shape.angle) * sinf(shape.angle) +
+                                         shape.height * shape.height * cosf(shape.angle) * cosf(shape.angle)));
+  int cy = (int)shape.y;
+
+  for (int y = std::max(cy - rows, 0); y <= std::min(cy + rows, h - 1); y++) {
+    float dy = y - shape.y;
+    float rest = limit - rowCoef * dy * dy;
+    if (rest < 0.0f) continue;
+
+    float mid = shape.x - f.B * dy / f.A;
+    float half = sqrtf(rest / f.A);
+    int x0 = std::max((int)ceilf(mid - half), 0);
+    int x1 = std::min((int)floorf(mid + half) + 1, w);
+    if (x0 < x1) {
+      spans.push_back(Span{y, x0, x1});
+    }
+  }
+}
+
+// Per channel, with d = cur - org and per-pixel alpha a = opacity*weight, the
+// blended error is sum(d^2) + 2*opacity*(c*S1 - S2) + opacity^2*(c^2*W2 - 2*c*S3 + S4).
+struct SplatSums {
+  double s1[3] = {}; // sum(w*d)
+  double s2[3] = {}; // sum(w*d*cur)
+  double s3[3] = {}; // sum(w^2*cur)
+  double s4[3] = {}; // sum(w^2*cur^2)
+  double w2 = 0.0;   // sum(w^2)
+};
+
+static float SplatGain(const SplatSums& sums, const float c[3], float opacity) {
+  double gain = 0.0;
+  for (int ch = 0; ch < 3; ch++) {
+    gain -= 2.0 * opacity * (c[ch] * sums.s1[ch] - sums.s2[ch]);
+    gain -= (double)opacity * opacity * (c[ch] * c[ch] * sums.w2 - 2.0 * c[ch] * sums.s3[ch] + sums.s4[ch]);
+  }
+  return (float)gain;
+}
+
+float ScoreSplat(Shape& shape, const ImageStats& stats, const std::vector<Span>& spans) {
+  SplatForm f = GetSplatForm(shape);
+  const Color* org = Pixels(stats.original);
+  const Color* cur = Pixels(stats.current);
+
+  thread_local std::vector<float> weights;
+  weights.resize(stats.width);
+
+  SplatSums sums;
+  for (const Span& s : spans) {
+    SplatRowWeights(shape, f, s, weights.data());
+
+    const Color* o = org + s.y * stats.width + s.x0;
+    const Color* c = cur + s.y * stats.width + s.x0;
+    int count = s.x1 - s.x0;
+    const unsigned char* importance = stats.weights ? &stats.weights->w[s.y * stats.width + s.x0] : nullptr;
+
+    float row[3][4] = {};
+    float rowW2 = 0.0f;
+    for (int i = 0; i < count; i++) {
+      // Importance scales every term of the pixel's error.
+      float p = importance ? importance[i] : 1.0f;
+      float wt = p * weights[i];
+      float w2 = wt * weights[i];
+      float cv[3] = {(float)c[i].r, (float)c[i].g, (float)c[i].b};
+      float ov[3] = {(float)o[i].r, (float)o[i].g, (float)o[i].b};
+      for (int ch = 0; ch < 3; ch++) {
+        float d = cv[ch] - ov[ch];
+        row[ch][0] += wt * d;
+        row[ch][1] += wt * d * cv[ch];
+        row[ch][2] += w2 * cv[ch];
+        row[ch][3] += w2 * cv[ch] * cv[ch];
+      }
+      rowW2 += w2;
+    }
+
+    for (int ch = 0; ch < 3; ch++) {
+      sums.s1[ch] += row[ch][0];
+      sums.s2[ch] += row[ch][1];
+      sums.s3[ch] += row[ch][2];
+      sums.s4[ch] += row[ch][3];
+    }
+    sums.w2 += rowW2;
+  }
+
+  if (sums.w2 <= 0.0) {
+    return -1e30f;
+  }
+
+  float gain = -1e30f;
+  auto tryOpacity = [&](unsigned char alpha) {
+    float opacity = alpha / 255.0f;
+    float c[3];
+    for (int ch = 0; ch < 3; ch++) {
+      double best = (sums.s3[ch] - sums.s1[ch] / opacity) / sums.w2;
+      c[ch] = (float)std::clamp(std::round(best), 0.0, 255.0);
+    }
+
+    float d = SplatGain(sums, c, opacity);
+    if (d > gain) {
+      gain = d;
+      shape.c = Color{(unsigned char)c[0], (unsigned char)c[1], (unsigned char)c[2], alpha};
+    }
+  };
+
+  tryOpacity(255);
+  if (BLEND_SHAPES) {
+    for (unsigned char alpha : ALPHA_LEVELS) {
+      tryOpacity(alpha);
+    }
+  }
+
+  return gain;
+}
+
+void DrawSplat(Image* dst, const Shape& shape, const std::vector<Span>& spans) {
+  SplatForm f = GetSplatForm(shape);
+  Color* px = (Color*)dst->data;
+  float opacity = shape.c.a / 255.0f;
+  float target[3] = {(float)shape.c.r, (float)shape.c.g, (float)shape.c.b};
+
+  std::vector<float> weights(dst->width);
+  for (const Span& s : spans) {
+    SplatRowWeights(shape, f, s, weights.data());
+
+    Color* row = px + s.y * dst->width;
+    for (int x = s.x0; x < s.x1; x++) {
+      float a = opacity * weights[x - s.x0];
+      unsigned char* channels[3] = {&row[x].r, &row[x].g, &row[x].b};
+      for (int ch = 0; ch < 3; ch++) {
+        float v = *channels[ch] + a * (target[ch] - *channels[ch]);
+        *channels[ch] = (unsigned char)std::clamp(std::lround(v), 0L, 255L);
+      }
+      row[x].a = 255;
+    }
+  }
+}
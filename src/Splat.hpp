@@ -0,0 +1,18 @@
+#pragma once
+
+#include <vector>
+
+#include "ImageStats.hpp"
+#include "Shapes.hpp"
+
+// Footprint of a splat in standard deviations; weights beyond it are dropped.
+constexpr float SPLAT_SIGMAS = 3.0f;
+
+// Spans of the SPLAT_SIGMAS footprint ellipse.
+void RasterizeSplat(const Shape& shape, int w, int h, std::vector<Span>& spans);
+
+// Fits the splat color for each opacity level in closed form from weighted
+// sums over its footprint and returns the best gain.
+float ScoreSplat(Shape& shape, const ImageStats& stats, const std::vector<Span>& spans);
+
+void DrawSplat(Image* dst, const Shape& shape, const std::vector<Span>& spans);
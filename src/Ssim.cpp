@@ -0,0 +1,140 @@
+#include "Ssim.hpp"
+
+#include <algorithm>
+
+constexpr double SSIM_C1 = (0.01 * 255) * (0.01 * 255);
+constexpr double SSIM_C2 = (0.03 * 255) * (0.03 * 255);
+
+static unsigned char Luma(Color c) {
+  return (unsigned char)((77 * c.r + 150 * c.g + 29 * c.b) >> 8);
+}
+
+static void BuildCurrentRow(SsimTracker& t, int y, int from) {
+  int stride = t.width + 1;
+  for (int x = from; x < t.width; x++) {
+    int i = y * stride + x;
+    int c = t.curLuma[y * t.width + x];
+    int o = t.orgLuma[y * t.width + x];
+    t.curRow[i + 1] = t.curRow[i] + c;
+    t.curSqRow[i + 1] = t.curSqRow[i] + c * c;
+    t.crossRow[i + 1] = t.crossRow[i] + c * o;
+  }
+}
+
+static float WindowSsim(const SsimTracker& t, int wx, int wy) {
+  int x0 = wx * SSIM_STRIDE;
+  int y0 = wy * SSIM_STRIDE;
+  int x1 = x0 + SSIM_WINDOW;
+  int y1 = y0 + SSIM_WINDOW;
+  int stride = t.width + 1;
+
+  double so = t.orgSat[y1 * stride + x1] - t.orgSat[y0 * stride + x1] - t.orgSat[y1 * stride + x0] + t.orgSat[y0 * stride + x0];
+  double soo = t.orgSqSat[y1 * stride + x1] - t.orgSqSat[y0 * stride + x1] - t.orgSqSat[y1 * stride + x0] + t.orgSqSat[y0 * stride + x0];
+
+  long long sc = 0, scc = 0, sco = 0;
+  for (int y = y0; y < y1; y++) {
+    int a = y * stride + x0;
+    int b = y * stride + x1;
+    sc += t.curRow[b] - t.curRow[a];
+    scc += t.curSqRow[b] - t.curSqRow[a];
+    sco += t.crossRow[b] - t.crossRow[a];
+  }
+
+  double n = SSIM_WINDOW * SSIM_WINDOW;
+  double mo = so / n;
+  double mc = sc / n;
+  double vo = soo / n - mo * mo;
+  double vc = scc / n - mc * mc;
+  double cov = sco / n - mo * mc;
+
+  return (float)(((2.0 * mo * mc + SSIM_C1) * (2.0 * cov + SSIM_C2)) /
+                 ((mo * mo + mc * mc + SSIM_C1) * (vo + vc + SSIM_C2)));
+}
+
+SsimTracker CreateSsimTracker(Image original, Image current) {
+  SsimTracker t;
+  t.width = original.width;
+  t.height = original.height;
+  t.windowsX = std::max(0, (t.width - SSIM_WINDOW) / SSIM_STRIDE + 1);
+  t.windowsY = std::max(0, (t.height - SSIM_WINDOW) / SSIM_STRIDE + 1);
+
+  int stride = t.width + 1;
+  const Color* org = Pixels(original);
+  const Color* cur = Pixels(current);
+
+  t.orgLuma.resize((size_t)t.width * t.height);
+  t.curLuma.resize((size_t)t.width * t.height);
+  for (size_t i = 0; i < t.orgLuma.size(); i++) {
+    t.orgLuma[i] = Luma(org[i]);
+    t.curLuma[i] = Luma(cur[i]);
+  }
+
+  t.orgSat.assign((size_t)stride * (t.height + 1), 0);
+  t.orgSqSat.assign((size_t)stride * (t.height + 1), 0);
+  t.curRow.assign((size_t)stride * t.height, 0);
+  t.curSqRow.assign((size_t)stride * t.height, 0);
+  t.crossRow.assign((size_t)stride * t.height, 0);
+
+  for (int y = 0; y < t.height; y++) {
+    long long rowSum = 0, rowSq = 0;
+    for (int x = 0; x < t.width; x++) {
+      int v = t.orgLuma[y * t.width + x];
+      rowSum += v;
+      rowSq += v * v;
+      t.orgSat[(y + 1) * stride + x + 1] = t.orgSat[y * stride + x + 1] + rowSum;
+      t.orgSqSat[(y + 1) * stride + x + 1] = t.orgSqSat[y * stride + x + 1] + rowSq;
+    }
+    BuildCurrentRow(t, y, 0);
+  }
+
+  t.windows.resize((size_t)t.windowsX * t.windowsY);
+  for (int wy = 0; wy < t.windowsY; wy++) {
+    for (int wx = 0; wx < t.windowsX; wx++) {
+      float s = WindowSsim(t, wx, wy);
+      t.windows[wy * t.windowsX + wx] = s;
+      t.total += s;
+    }
+  }
+
+  return t;
+}
+
+void UpdateSsimTracker(SsimTracker& t, Image current, const std::vector<Span>& spans) {
+  if (spans.empty()) {
+    return;
+  }
+
+  const Color* cur = Pixels(current);
+  int bx0 = t.width, bx1 = 0;
+  int by0 = t.height, by1 = 0;
+
+  for (const Span& s : spans) {
+    for (int x = s.x0; x < s.x1; x++) {
+      t.curLuma[s.y * t.width + x] = Luma(cur[s.y * t.width + x]);
+    }
+    BuildCurrentRow(t, s.y, s.x0);
+
+    bx0 = std::min(bx0, s.x0);
+    bx1 = std::max(bx1, s.x1);
+    by0 = std::min(by0, s.y);
+    by1 = std::max(by1, s.y + 1);
+  }
+
+  // Windows [i*STRIDE, i*STRIDE + WINDOW) that intersect [b0, b1).
+  auto first = [](int b0) { return std::max(0, (b0 - SSIM_WINDOW + SSIM_STRIDE) / SSIM_STRIDE); };
+  int wx0 = first(bx0), wx1 = std::min(t.windowsX - 1, (bx1 - 1) / SSIM_STRIDE);
+  int wy0 = first(by0), wy1 = std::min(t.windowsY - 1, (by1 - 1) / SSIM_STRIDE);
+
+  for (int wy = wy0; wy <= wy1; wy++) {
+    for (int wx = wx0; wx <= wx1; wx++) {
+      float& s = t.windows[wy * t.windowsX + wx];
+      float updated = WindowSsim(t, wx, wy);
+      t.total += updated - s;
+      s = updated;
+    }
+  }
+}
+
+float MeanSsim(const SsimTracker& t) {
+  return t.windows.empty() ? 1.0f : (float)(t.total / t.windows.size());
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+#include "../include/raylib.h"
+#include "ImageStats.hpp"
+
+constexpr int SSIM_WINDOW = 8;
+constexpr int SSIM_STRIDE = 4;
+
+// Running mean SSIM between the luma of two RGB images over a grid of
+// SSIM_WINDOW windows, SSIM_STRIDE apart. The original's window moments come
+// from 2D integral images; the canvas keeps row prefix sums, so a commit only
+// refreshes its own rows and re-scores the windows it overlaps.
+struct SsimTracker {
+  int width = 0;
+  int height = 0;
+  int windowsX = 0;
+  int windowsY = 0;
+
+  std::vector<unsigned char> orgLuma, curLuma;
+  std::vector<long long> orgSat, orgSqSat;   // (width + 1) x (height + 1)
+  std::vector<long long> curRow, curSqRow, crossRow; // width + 1 per row
+
+  std::vector<float> windows;
+  double total = 0.0;
+};
+
+// Both images RGB (not metric space), PIXELFORMAT_UNCOMPRESSED_R8G8B8A8.
+SsimTracker CreateSsimTracker(Image original, Image current);
+
+// Refreshes the tracker after the pixels under spans changed in current.
+void UpdateSsimTracker(SsimTracker& tracker, Image current, const std::vector<Span>& spans);
+
+float MeanSsim(const SsimTracker& tracker);
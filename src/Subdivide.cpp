@@ -0,0 +1,129 @@
+#include "Subdivide.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1).
+struct Region {
+  int x0, y0, x1, y1;
+};
+
+static SpanSums RegionSums(const ImageStats& stats, const Region& r) {
+  SpanSums sums;
+  sums.r = SatSum(stats, SAT_R, r.x0, r.y0, r.x1, r.y1);
+  sums.g = SatSum(stats, SAT_G, r.x0, r.y0, r.x1, r.y1);
+  sums.b = SatSum(stats, SAT_B, r.x0, r.y0, r.x1, r.y1);
+  sums.sq = SatSum(stats, SAT_SQ, r.x0, r.y0, r.x1, r.y1);
+  sums.n = SatSum(stats, SAT_W, r.x0, r.y0, r.x1, r.y1);
+  return sums;
+}
+
+static bool IsLeaf(const ImageStats& stats, const Region& r, float maxVariance, int minSize) {
+  if (r.x1 - r.x0 < 2 * minSize || r.y1 - r.y0 < 2 * minSize) {
+    return true;
+  }
+
+  SpanSums s = RegionSums(stats, r);
+  if (s.n == 0) {
+    return true;
+  }
+  double n = (double)s.n;
+  double variance = (s.sq - ((double)s.r * s.r + (double)s.g * s.g + (double)s.b * s.b) / n) / n;
+  return variance <= maxVariance;
+}
+
+// Quadrants in row-major order.
+static void Split(const Region& r, Region* out) {
+  int mx = (r.x0 + r.x1) / 2;
+  int my = (r.y0 + r.y1) / 2;
+  out[0] = Region{r.x0, r.y0, mx, my};
+  out[1] = Region{mx, r.y0, r.x1, my};
+  out[2] = Region{r.x0, my, mx, r.y1};
+  out[3] = Region{mx, my, r.x1, r.y1};
+}
+
+static void EmitLeaf(const ImageStats& stats, const Region& r, std::vector<Shape>& out) {
+  SpanSums s = RegionSums(stats, r);
+  if (s.n == 0) {
+    return;
+  }
+
+  Shape shape{};
+  shape.type = SHAPE_RECTANGLE;
+  shape.x = (float)r.x0;
+  shape.y = (float)r.y0;
+  shape.width = (float)(r.x1 - r.x0);
+  shape.height = (float)(r.y1 - r.y0);
+  shape.c = GetBestSpanColor(s);
+  out.push_back(shape);
+}
+
+static void SubdivideRegion(const ImageStats& stats, const Region& r, float maxVariance, int minSize,
+                            std::vector<Shape>& out) {
+  if (IsLeaf(stats, r, maxVariance, minSize)) {
+    EmitLeaf(stats, r, out);
+    return;
+  }
+
+  Region quadrants[4];
+  Split(r, quadrants);
+  for (const Region& q : quadrants) {
+    SubdivideRegion(stats, q, maxVariance, minSize, out);
+  }
+}
+
+std::vector<Shape> SubdivideImage(const ImageStats& stats, float maxVariance, int minSize, int threads) {
+  int numThreads = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+  numThreads = std::max(1, numThreads);
+
+  // Expand breadth-first until there are a few subtrees per thread. A node
+  // is replaced by its quadrants in place, so concatenating the subtrees'
+  // leaves in frontier order gives the depth-first order of the whole tree.
+  std::vector<Region> frontier = {Region{0, 0, stats.width, stats.height}};
+  while ((int)frontier.size() < 4 * numThreads) {
+    std::vector<Region> next;
+    bool split = false;
+    for (const Region& r : frontier) {
+      if (IsLeaf(stats, r, maxVariance, minSize)) {
+        next.push_back(r);
+        continue;
+      }
+      Region quadrants[4];
+      Split(r, quadrants);
+      next.insert(next.end(), quadrants, quadrants + 4);
+      split = true;
+    }
+    frontier.swap(next);
+    if (!split) {
+      break;
+    }
+  }
+
+  std::vector<std::vector<Shape>> parts(frontier.size());
+  std::atomic<int> nextPart{0};
+  auto worker = [&]() {
+    for (int i = nextPart++; i < (int)frontier.size(); i = nextPart++) {
+      SubdivideRegion(stats, frontier[i], maxVariance, minSize, parts[i]);
+    }
+  };
+
+  int workers = std::min(numThreads, (int)frontier.size());
+  if (workers == 1) {
+    worker();
+  } else {
+    std::vector<std::thread> pool;
+    for (int t = 0; t < workers; t++) {
+      pool.emplace_back(worker);
+    }
+    for (auto& t : pool) {
+      t.join();
+    }
+  }
+
+  std::vector<Shape> shapes;
+  for (const std::vector<Shape>& part : parts) {
+    shapes.insert(shapes.end(), part.begin(), part.end());
+  }
+  return shapes;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+
+#include "ImageStats.hpp"
+#include "Shapes.hpp"
+
+// Regions whose variance (per pixel, summed over the channels) is above this
+// get split.
+constexpr float SUBDIVIDE_VARIANCE = 200.0f;
+// Regions narrower or shorter than twice this are never split.
+constexpr int SUBDIVIDE_MIN_SIZE = 4;
+
+// Deterministic approximation of the stats' original for previews and warm
+// starts: splits the image into quadrants while a region's variance, read in
+// O(1) from the integral images, exceeds maxVariance and both its sides are
+// at least 2 * minSize. Every leaf becomes an opaque SHAPE_RECTANGLE with the
+// region's mean color, in the stats' color space; leaves without weight
+// (outside a region of interest) are dropped. Subtrees run on up to threads
+// threads (0 uses every hardware thread), and the leaves come out in the same
+// depth-first order whatever the count.
+std::vector<Shape> SubdivideImage(const ImageStats& stats, float maxVariance = SUBDIVIDE_VARIANCE,
+                                  int minSize = SUBDIVIDE_MIN_SIZE, int threads = 0);
@@ -0,0 +1,262 @@
+#include "Superpixel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <thread>
+
+// Box-filtered original, factor x factor pixels per cell. Cells without weight
+// are not valid and belong to no superpixel.
+struct SuperpixelGrid {
+  int width = 0;
+  int height = 0;
+  int factor = 1;
+  std::vector<Color> cells;
+  std::vector<unsigned char> valid;
+};
+
+// Initial centers sit on a cols x rows lattice of step stepX x stepY cells; a
+// cell is only compared against the centers seeded around its lattice cell.
+struct SuperpixelLattice {
+  int cols = 1;
+  int rows = 1;
+  float stepX = 1.0f;
+  float stepY = 1.0f;
+};
+
+struct SuperpixelCenter {
+  float x, y;
+  float r, g, b;
+  bool alive;
+};
+
+// Integer sums over a superpixel's cells, so they add up the same in any
+// order.
+struct SuperpixelMoments {
+  long long n = 0;
+  long long x = 0, y = 0;
+  long long xx = 0, xy = 0, yy = 0;
+  long long r = 0, g = 0, b = 0;
+  int x0 = INT_MAX, y0 = INT_MAX;
+  int x1 = INT_MIN, y1 = INT_MIN;
+};
+
+static SuperpixelGrid Downscale(const ImageStats& stats) {
+  SuperpixelGrid grid;
+  long long pixels = (long long)stats.width * stats.height;
+  grid.factor = std::max(1, (int)ceil(sqrt((double)pixels / SUPERPIXEL_MAX_PIXELS)));
+  grid.width = (stats.width + grid.factor - 1) / grid.factor;
+  grid.height = (stats.height + grid.factor - 1) / grid.factor;
+  grid.cells.resize((size_t)grid.width * grid.height);
+  grid.valid.resize((size_t)grid.width * grid.height);
+
+  for (int gy = 0; gy < grid.height; gy++) {
+    int y0 = gy * grid.factor;
+    int y1 = std::min(y0 + grid.factor, stats.height);
+    for (int gx = 0; gx < grid.width; gx++) {
+      int x0 = gx * grid.factor;
+      int x1 = std::min(x0 + grid.factor, stats.width);
+      long long n = SatSum(stats, SAT_W, x0, y0, x1, y1);
+      int i = gy * grid.width + gx;
+      grid.valid[i] = n > 0;
+      if (n > 0) {
+        grid.cells[i] = Color{(unsigned char)((SatSum(stats, SAT_R, x0, y0, x1, y1) + n / 2) / n),
+                              (unsigned char)((SatSum(stats, SAT_G, x0, y0, x1, y1) + n / 2) / n),
+                              (unsigned char)((SatSum(stats, SAT_B, x0, y0, x1, y1) + n / 2) / n), 255};
+      }
+    }
+  }
+  return grid;
+}
+
+static void Accumulate(SuperpixelMoments& m, int x, int y, Color c) {
+  m.n++;
+  m.x += x;
+  m.y += y;
+  m.xx += (long long)x * x;
+  m.xy += (long long)x * y;
+  m.yy += (long long)y * y;
+  m.r += c.r;
+  m.g += c.g;
+  m.b += c.b;
+  m.x0 = std::min(m.x0, x);
+  m.y0 = std::min(m.y0, y);
+  m.x1 = std::max(m.x1, x + 1);
+  m.y1 = std::max(m.y1, y + 1);
+}
+
+static void Merge(SuperpixelMoments& dst, const SuperpixelMoments& src) {
+  dst.n += src.n;
+  dst.x += src.x;
+  dst.y += src.y;
+  dst.xx += src.xx;
+  dst.xy += src.xy;
+  dst.yy += src.yy;
+  dst.r += src.r;
+  dst.g += src.g;
+  dst.b += src.b;
+  dst.x0 = std::min(dst.x0, src.x0);
+  dst.y0 = std::min(dst.y0, src.y0);
+  dst.x1 = std::max(dst.x1, src.x1);
+  dst.y1 = std::max(dst.y1, src.y1);
+}
+
+// Assigns every valid cell to the nearest center around it (or, when seeding,
+// to its lattice cell's center) and sums up the new superpixels.
+static std::vector<SuperpixelMoments> AssignCells(const SuperpixelGrid& grid, const SuperpixelLattice& lattice,
+                                                  const std::vector<SuperpixelCenter>& centers, float spatialWeight,
+                                                  bool seeding, int numThreads) {
+  int count = lattice.cols * lattice.rows;
+  int workers = std::max(1, std::min(numThreads, grid.height));
+  std::vector<std::vector<SuperpixelMoments>> parts(workers, std::vector<SuperpixelMoments>(count));
+  std::atomic<int> nextRow{0};
+
+  auto worker = [&](int t) {
+    std::vector<SuperpixelMoments>& sums = parts[t];
+    for (int y = nextRow++; y < grid.height; y = nextRow++) {
+      int hy = std::min(lattice.rows - 1, (int)(y / lattice.stepY));
+      for (int x = 0; x < grid.width; x++) {
+        int i = y * grid.width + x;
+        if (!grid.valid[i]) {
+          continue;
+        }
+        Color c = grid.cells[i];
+        int hx = std::min(lattice.cols - 1, (int)(x / lattice.stepX));
+        int best = hy * lattice.cols + hx;
+
+        if (!seeding) {
+          float bestDist = 1e30f;
+          for (int ly = std::max(0, hy - 1); ly <= std::min(lattice.rows - 1, hy + 1); ly++) {
+            for (int lx = std::max(0, hx - 1); lx <= std::min(lattice.cols - 1, hx + 1); lx++) {
+              const SuperpixelCenter& center = centers[ly * lattice.cols + lx];
+              if (!center.alive) {
+                continue;
+              }
+              float dr = c.r - center.r, dg = c.g - center.g, db = c.b - center.b;
+              float dx = x - center.x, dy = y - center.y;
+              float dist = dr * dr + dg * dg + db * db + spatialWeight * (dx * dx + dy * dy);
+              if (dist < bestDist) {
+                bestDist = dist;
+                best = ly * lattice.cols + lx;
+              }
+            }
+          }
+        }
+        Accumulate(sums[best], x, y, c);
+      }
+    }
+  };
+
+  if (workers == 1) {
+    worker(0);
+  } else {
+    std::vector<std::thread> pool;
+    for (int t = 0; t < workers; t++) {
+      pool.emplace_back(worker, t);
+    }
+    for (auto& t : pool) {
+      t.join();
+    }
+  }
+
+  for (int t = 1; t < workers; t++) {
+    for (int k = 0; k < count; k++) {
+      Merge(parts[0][k], parts[t][k]);
+    }
+  }
+  return std::move(parts[0]);
+}
+
+static void UpdateCenters(const std::vector<SuperpixelMoments>& moments, std::vector<SuperpixelCenter>& centers) {
+  for (size_t k = 0; k < moments.size(); k++) {
+    const SuperpixelMoments& m = moments[k];
+    SuperpixelCenter& center = centers[k];
+    center.alive = m.n > 0;
+    if (center.alive) {
+      float n = (float)m.n;
+      center.x = m.x / n;
+      center.y = m.y / n;
+      center.r = m.r / n;
+      center.g = m.g / n;
+      center.b = m.b / n;
+    }
+  }
+}
+
+// Cell moments to a shape in image coordinates. The covariance of a uniform
+// ellipse is a quarter of its squared semi-axes, so those come out of its
+// eigenvalues; each cell adds the 1/12 variance of its own extent.
+static Shape MomentsToShape(const SuperpixelMoments& m, const ImageStats& stats, int factor, ShapeType type) {
+  Shape shape{};
+  double n = (double)m.n;
+  shape.c = Color{(unsigned char)((m.r + m.n / 2) / m.n), (unsigned char)((m.g + m.n / 2) / m.n),
+                  (unsigned char)((m.b + m.n / 2) / m.n), 255};
+
+  if (type == SHAPE_RECTANGLE) {
+    shape.type = SHAPE_RECTANGLE;
+    shape.x = (float)(m.x0 * factor);
+    shape.y = (float)(m.y0 * factor);
+    shape.width = (float)(std::min(m.x1 * factor, stats.width) - m.x0 * factor);
+    shape.height = (float)(std::min(m.y1 * factor, stats.height) - m.y0 * factor);
+    return shape;
+  }
+
+  double mx = m.x / n;
+  double my = m.y / n;
+  double cxx = m.xx / n - mx * mx + 1.0 / 12.0;
+  double cyy = m.yy / n - my * my + 1.0 / 12.0;
+  double cxy = m.xy / n - mx * my;
+  double mid = 0.5 * (cxx + cyy);
+  double spread = sqrt(0.25 * (cxx - cyy) * (cxx - cyy) + cxy * cxy);
+
+  shape.type = SHAPE_ELLIPSE;
+  shape.x = (float)((mx + 0.5) * factor);
+  shape.y = (float)((my + 0.5) * factor);
+  shape.width = std::max(1.0f, (float)(2.0 * sqrt(mid + spread) * factor));
+  shape.height = std::max(1.0f, (float)(2.0 * sqrt(std::max(mid - spread, 0.0)) * factor));
+  shape.angle = (float)(0.5 * atan2(2.0 * cxy, cxx - cyy));
+  if (shape.angle < 0.0f) {
+    shape.angle += PI;
+  }
+  return shape;
+}
+
+std::vector<Shape> SuperpixelShapes(const ImageStats& stats, ShapeType type, int count, float compactness,
+                                    int threads) {
+  int numThreads = threads > 0 ? threads : (int)std::thread::hardware_concurrency();
+  numThreads = std::max(1, numThreads);
+
+  SuperpixelGrid grid = Downscale(stats);
+  SuperpixelLattice lattice;
+  float step = sqrtf((float)grid.width * grid.height / std::max(1, count));
+  lattice.cols = std::max(1, (int)lroundf(grid.width / step));
+  lattice.rows = std::max(1, (int)lroundf(grid.height / step));
+  lattice.stepX = (float)grid.width / lattice.cols;
+  lattice.stepY = (float)grid.height / lattice.rows;
+
+  // SLIC distance: color distance plus the spatial one scaled by m / S.
+  float spatialWeight = (compactness * compactness) / (lattice.stepX * lattice.stepY);
+
+  std::vector<SuperpixelCenter> centers(lattice.cols * lattice.rows);
+  std::vector<SuperpixelMoments> moments = AssignCells(grid, lattice, centers, spatialWeight, true, numThreads);
+  for (int iteration = 0; iteration < SUPERPIXEL_ITERATIONS; iteration++) {
+    UpdateCenters(moments, centers);
+    moments = AssignCells(grid, lattice, centers, spatialWeight, false, numThreads);
+  }
+
+  std::vector<int> order;
+  for (int k = 0; k < (int)moments.size(); k++) {
+    if (moments[k].n > 0) {
+      order.push_back(k);
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return moments[a].n > moments[b].n; });
+
+  std::vector<Shape> shapes;
+  shapes.reserve(order.size());
+  for (int k : order) {
+    shapes.push_back(MomentsToShape(moments[k], stats, grid.factor, type));
+  }
+  return shapes;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include "ImageStats.hpp"
+#include "Shapes.hpp"
+
+// Superpixels the image is segmented into, roughly.
+constexpr int SUPERPIXEL_COUNT = 400;
+// Weight of spatial distance against color distance; higher gives rounder,
+// more regular superpixels.
+constexpr float SUPERPIXEL_COMPACTNESS = 20.0f;
+constexpr int SUPERPIXEL_ITERATIONS = 10;
+// The original is box-filtered down to about this many pixels first.
+constexpr int SUPERPIXEL_MAX_PIXELS = 256 * 256;
+
+// Warm start from a SLIC segmentation of the stats' original: each superpixel
+// becomes one opaque shape in its mean color, in the stats' color space, either
+// a SHAPE_ELLIPSE fitted to its second moments or a SHAPE_RECTANGLE over its
+// bounding box. Shapes come out largest first so small superpixels end up on
+// top. Pixels without weight (outside a region of interest) are left out.
+// Superpixels are not forced to be connected, so a stray fragment only
+// stretches the fit a little. Rows are split over up to threads threads (0
+// uses every hardware thread); the result is the same whatever the count.
+std::vector<Shape> SuperpixelShapes(const ImageStats& stats, ShapeType type = SHAPE_ELLIPSE,
+                                    int count = SUPERPIXEL_COUNT, float compactness = SUPERPIXEL_COMPACTNESS,
+                                    int threads = 0);
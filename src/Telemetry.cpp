@@ -0,0 +1,204 @@
+#include "Telemetry.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Splat.hpp"
+
+// Bounding extent of the shape before rotation.
+static void ShapeExtent(const Shape& shape, float& longSide, float& shortSide) {
+  float a = shape.width;
+  float b = shape.height;
+
+  switch (shape.type) {
+    case SHAPE_CIRCLE:
+      a = b = 2.0f * shape.width;
+      break;
+    case SHAPE_ELLIPSE:
+    case SHAPE_ROTATED_RECTANGLE:
+      a = 2.0f * shape.width;
+      b = 2.0f * shape.height;
+      break;
+    case SHAPE_SPLAT:
+      a = 2.0f * SPLAT_SIGMAS * shape.width;
+      b = 2.0f * SPLAT_SIGMAS * shape.height;
+      break;
+    case SHAPE_TRIANGLE:
+    case SHAPE_POLYGON: {
+      float minX = shape.points[0].x, maxX = minX;
+      float minY = shape.points[0].y, maxY = minY;
+      for (int i = 1; i < shape.pointCount; i++) {
+        minX = std::min(minX, shape.points[i].x);
+        maxX = std::max(maxX, shape.points[i].x);
+        minY = std::min(minY, shape.points[i].y);
+        maxY = std::max(maxY, shape.points[i].y);
+      }
+      a = maxX - minX + 1.0f;
+      b = maxY - minY + 1.0f;
+      break;
+    }
+    case SHAPE_STROKE: {
+      float dx = shape.points[1].x - shape.points[0].x;
+      float dy = shape.points[1].y - shape.points[0].y;
+      a = std::sqrt(dx * dx + dy * dy) + 1.0f;
+      b = shape.width;
+      break;
+    }
+    default:
+      break;
+  }
+
+  a = std::max(a, 1.0f);
+  b = std::max(b, 1.0f);
+  longSide = std::max(a, b);
+  shortSide = std::min(a, b);
+}
+
+static int Log2Bin(float v, int bins) {
+  int bin = 0;
+  while (v >= 2.0f && bin < bins - 1) {
+    v *= 0.5f;
+    bin++;
+  }
+  return bin;
+}
+
+static void CountShape(const Shape& shape, long long* sizes, long long* aspects) {
+  float longSide, shortSide;
+  ShapeExtent(shape, longSide, shortSide);
+  sizes[Log2Bin(longSide, TELEMETRY_SIZE_BINS)]++;
+  aspects[Log2Bin(longSide / shortSide, TELEMETRY_ASPECT_BINS)]++;
+}
+
+static long long RowSse(const SearchTelemetry& t, const Color* cur, int y) {
+  long long e = 0;
+  const Color* o = &t.original[y * t.width];
+  const Color* c = &cur[y * t.width];
+  for (int x = 0; x < t.width; x++) {
+    int dr = c[x].r - o[x].r;
+    int dg = c[x].g - o[x].g;
+    int db = c[x].b - o[x].b;
+    e += dr * dr + dg * dg + db * db;
+  }
+  return e;
+}
+
+SearchTelemetry CreateSearchTelemetry(Image original, Image current, const char* csvPath, const char* histogramPath) {
+  SearchTelemetry t;
+  t.width = original.width;
+  t.height = original.height;
+  t.original.assign(Pixels(original), Pixels(original) + t.width * t.height);
+  t.histogramPath = histogramPath;
+
+  t.rowSse.resize(t.height);
+  for (int y = 0; y < t.height; y++) {
+    t.rowSse[y] = RowSse(t, Pixels(current), y);
+    t.sse += t.rowSse[y];
+  }
+
+  t.csv = csvPath ? fopen(csvPath, "w") : nullptr;
+  if (t.csv) {
+    fprintf(t.csv, "iteration,candidates,wasted_ratio,pruned_ratio,gain_mean,gain_p50,gain_p90,best_gain,refined_gain,"
+                   "winner_type,winner_long,winner_short,mse,psnr\n");
+  }
+
+  return t;
+}
+
+void RecordCandidates(SearchTelemetry& t, const Shape* shapes, const float* gains, int count) {
+  std::vector<float> sorted;
+  sorted.reserve(count);
+  double sum = 0.0;
+  t.wasted = 0;
+  t.pruned = 0;
+
+  for (int i = 0; i < count; i++) {
+    CountShape(shapes[i], t.proposedSize, t.proposedAspect);
+    if (gains[i] == PRUNED_GAIN) {
+      t.pruned++;
+      continue;
+    }
+    sorted.push_back(gains[i]);
+    sum += gains[i];
+    if (gains[i] <= 0.0f) {
+      t.wasted++;
+    }
+  }
+
+  t.candidates = count;
+  int scored = (int)sorted.size();
+  if (scored == 0) {
+    t.gainMean = t.gainP50 = t.gainP90 = t.bestGain = 0.0f;
+    return;
+  }
+
+  std::sort(sorted.begin(), sorted.end());
+  t.gainMean = (float)(sum / scored);
+  t.gainP50 = sorted[scored / 2];
+  t.gainP90 = sorted[std::min(scored - 1, scored * 9 / 10)];
+  t.bestGain = sorted.back();
+}
+
+void RecordCanvas(SearchTelemetry& t, Image current, const std::vector<Span>& spans) {
+  // Spans are ordered by y, with possibly several per row.
+  int lastRow = -1;
+  for (const Span& s : spans) {
+    if (s.y == lastRow) {
+      continue;
+    }
+    lastRow = s.y;
+    long long e = RowSse(t, Pixels(current), s.y);
+    t.sse += e - t.rowSse[s.y];
+    t.rowSse[s.y] = e;
+  }
+}
+
+void RecordCommit(SearchTelemetry& t, int iteration, const Shape& winner, float gain) {
+  CountShape(winner, t.winnerSize, t.winnerAspect);
+
+  if (!t.csv) {
+    return;
+  }
+
+  float longSide, shortSide;
+  ShapeExtent(winner, longSide, shortSide);
+  fprintf(t.csv, "%d,%d,%.4f,%.4f,%.2f,%.2f,%.2f,%.2f,%.2f,%d,%.1f,%.1f,%.4f,%.4f\n",
+          iteration, t.candidates, t.candidates ? (float)t.wasted / t.candidates : 0.0f,
+          t.candidates ? (float)t.pruned / t.candidates : 0.0f,
+          t.gainMean, t.gainP50, t.gainP90, t.bestGain, gain,
+          (int)winner.type, longSide, shortSide, TelemetryMse(t), TelemetryPsnr(t));
+}
+
+double TelemetryMse(const SearchTelemetry& t) {
+  long long samples = 3LL * t.width * t.height;
+  return samples > 0 ? (double)t.sse / samples : 0.0;
+}
+
+double TelemetryPsnr(const SearchTelemetry& t) {
+  double mse = TelemetryMse(t);
+  if (mse <= 0.0) {
+    return 99.0;
+  }
+  return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+void CloseSearchTelemetry(SearchTelemetry& t) {
+  if (t.csv) {
+    fclose(t.csv);
+    t.csv = nullptr;
+  }
+
+  FILE* f = t.histogramPath ? fopen(t.histogramPath, "w") : nullptr;
+  if (!f) {
+    return;
+  }
+
+  fprintf(f, "kind,bin,lower,proposals,winners\n");
+  for (int i = 0; i < TELEMETRY_SIZE_BINS; i++) {
+    fprintf(f, "size,%d,%d,%lld,%lld\n", i, 1 << i, t.proposedSize[i], t.winnerSize[i]);
+  }
+  for (int i = 0; i < TELEMETRY_ASPECT_BINS; i++) {
+    fprintf(f, "aspect,%d,%d,%lld,%lld\n", i, 1 << i, t.proposedAspect[i], t.winnerAspect[i]);
+  }
+  fclose(f);
+}
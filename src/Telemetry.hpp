@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+#include "../include/raylib.h"
+#include "ImageStats.hpp"
+#include "Shapes.hpp"
+
+// Longer side in powers of two: [1, 2), [2, 4), ... with the last bin open.
+constexpr int TELEMETRY_SIZE_BINS = 10;
+// Long/short side ratio in powers of two, same layout.
+constexpr int TELEMETRY_ASPECT_BINS = 8;
+
+// Gain recorded for candidates the search skipped without scoring. They count
+// as pruned rather than wasted and stay out of the gain statistics.
+constexpr float PRUNED_GAIN = -3e38f;
+
+// How well the random search is doing: the spread of candidate gains, how many
+// candidates were wasted (gain <= 0), what sizes get proposed versus what wins,
+// and the running RGB MSE/PSNR of the displayed canvas. One CSV row per
+// iteration; the size/aspect histograms are written when closing.
+struct SearchTelemetry {
+  int width = 0;
+  int height = 0;
+
+  std::vector<Color> original; // RGB copy, the stats hold metric space
+  std::vector<long long> rowSse;
+  long long sse = 0;
+
+  long long proposedSize[TELEMETRY_SIZE_BINS] = {};
+  long long winnerSize[TELEMETRY_SIZE_BINS] = {};
+  long long proposedAspect[TELEMETRY_ASPECT_BINS] = {};
+  long long winnerAspect[TELEMETRY_ASPECT_BINS] = {};
+
+  // Candidate summary of the iteration in progress.
+  int candidates = 0;
+  int wasted = 0;
+  int pruned = 0;
+  float gainMean = 0.0f;
+  float gainP50 = 0.0f;
+  float gainP90 = 0.0f;
+  float bestGain = 0.0f;
+
+  FILE* csv = nullptr;
+  const char* histogramPath = nullptr;
+};
+
+// original and current are RGB (not metric space). Returns a telemetry with
+// no csv when the file cannot be opened; recording still works.
+SearchTelemetry CreateSearchTelemetry(Image original, Image current, const char* csvPath, const char* histogramPath);
+
+// Candidates scored this iteration, before refinement.
+void RecordCandidates(SearchTelemetry& t, const Shape* shapes, const float* gains, int count);
+
+// Refreshes the running MSE for the rows under spans, with current the RGB
+// canvas after they were drawn. Every drawn shape goes through here.
+void RecordCanvas(SearchTelemetry& t, Image current, const std::vector<Span>& spans);
+
+// The shape a search iteration committed and its gain after refinement, after
+// RecordCanvas. Appends the iteration's CSV row.
+void RecordCommit(SearchTelemetry& t, int iteration, const Shape& winner, float gain);
+
+double TelemetryMse(const SearchTelemetry& t);
+double TelemetryPsnr(const SearchTelemetry& t);
+
+// Writes the histograms and closes the files.
+void CloseSearchTelemetry(SearchTelemetry& t);
@@ -0,0 +1,153 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+struct TraceRecord {
+  long long start;
+  long long end;
+  int phase;
+};
+
+struct TraceBuffer {
+  std::vector<TraceRecord> records;
+  long long written = 0;
+  bool inUse = false;
+};
+
+static std::mutex poolMutex;
+static std::vector<std::unique_ptr<TraceBuffer>> pool;
+
+static TraceBuffer* AcquireBuffer(int& lane) {
+  std::lock_guard<std::mutex> lock(poolMutex);
+  for (size_t i = 0; i < pool.size(); i++) {
+    if (!pool[i]->inUse) {
+      pool[i]->inUse = true;
+      lane = (int)i;
+      return pool[i].get();
+    }
+  }
+
+  pool.push_back(std::make_unique<TraceBuffer>());
+  pool.back()->records.resize(TRACE_CAPACITY);
+  pool.back()->inUse = true;
+  lane = (int)pool.size() - 1;
+  return pool.back().get();
+}
+
+struct TraceLane {
+  TraceBuffer* buffer = nullptr;
+  int lane = 0;
+
+  ~TraceLane() {
+    if (buffer) {
+      std::lock_guard<std::mutex> lock(poolMutex);
+      buffer->inUse = false;
+    }
+  }
+};
+
+static thread_local TraceLane currentLane;
+
+static const std::chrono::steady_clock::time_point traceEpoch = std::chrono::steady_clock::now();
+
+long long TraceNow() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - traceEpoch).count();
+}
+
+void TraceEvent(TracePhase phase, long long start, long long end) {
+  if (!currentLane.buffer) {
+    currentLane.buffer = AcquireBuffer(currentLane.lane);
+  }
+
+  TraceBuffer& b = *currentLane.buffer;
+  b.records[b.written % TRACE_CAPACITY] = TraceRecord{start, end, (int)phase};
+  b.written++;
+}
+
+const char* TracePhaseName(TracePhase phase) {
+  switch (phase) {
+    case PHASE_GENERATE: return "generate";
+    case PHASE_SCORE: return "score";
+    case PHASE_REDUCE: return "reduce";
+    case PHASE_REFINE: return "refine";
+    case PHASE_COLOR: return "color";
+    case PHASE_COMMIT: return "commit";
+    case PHASE_UPLOAD: return "upload";
+    case PHASE_PRESENT: return "present";
+    default: return "unknown";
+  }
+}
+
+bool WriteChromeTrace(const char* path) {
+  FILE* f = fopen(path, "w");
+  if (!f) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(poolMutex);
+  fprintf(f, "{\"traceEvents\":[\n");
+  bool first = true;
+
+  for (size_t lane = 0; lane < pool.size(); lane++) {
+    const TraceBuffer& b = *pool[lane];
+    long long count = std::min<long long>(b.written, TRACE_CAPACITY);
+    for (long long i = b.written - count; i < b.written; i++) {
+      const TraceRecord& r = b.records[i % TRACE_CAPACITY];
+      fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+              first ? "" : ",\n", TracePhaseName((TracePhase)r.phase), lane,
+              r.start / 1000.0, (r.end - r.start) / 1000.0);
+      first = false;
+    }
+  }
+
+  fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+  fclose(f);
+  return true;
+}
+
+void PrintTraceSummary(std::ostream& out) {
+  std::vector<long long> durations[PHASE_COUNT];
+
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    for (const auto& b : pool) {
+      long long count = std::min<long long>(b->written, TRACE_CAPACITY);
+      for (long long i = b->written - count; i < b->written; i++) {
+        const TraceRecord& r = b->records[i % TRACE_CAPACITY];
+        durations[r.phase].push_back(r.end - r.start);
+      }
+    }
+  }
+
+  out << std::left << std::setw(10) << "phase" << std::right
+      << std::setw(10) << "count" << std::setw(12) << "mean us"
+      << std::setw(12) << "p50 us" << std::setw(12) << "p90 us"
+      << std::setw(12) << "p99 us" << std::setw(12) << "max us" << "\n";
+  out << std::fixed << std::setprecision(2);
+
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    std::vector<long long>& d = durations[p];
+    if (d.empty()) {
+      continue;
+    }
+
+    std::sort(d.begin(), d.end());
+    double sum = 0.0;
+    for (long long v : d) sum += v;
+    auto pct = [&](double q) { return d[std::min(d.size() - 1, (size_t)(q * d.size()))] / 1000.0; };
+
+    out << std::left << std::setw(10) << TracePhaseName((TracePhase)p) << std::right
+        << std::setw(10) << d.size() << std::setw(12) << sum / d.size() / 1000.0
+        << std::setw(12) << pct(0.5) << std::setw(12) << pct(0.9)
+        << std::setw(12) << pct(0.99) << std::setw(12) << d.back() / 1000.0 << "\n";
+  }
+
+  out << std::defaultfloat;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <iosfwd>
+
+// Compiled out entirely when false.
+constexpr bool TRACING = true;
+
+// Events kept per thread; older ones are overwritten.
+constexpr int TRACE_CAPACITY = 1 << 16;
+
+enum TracePhase {
+  PHASE_GENERATE = 0,
+  PHASE_SCORE,   // rasterize, fit the color and compute the gain
+  PHASE_REDUCE,
+  PHASE_REFINE,
+  PHASE_COLOR,   // exact median for robust colors
+  PHASE_COMMIT,
+  PHASE_UPLOAD,
+  PHASE_PRESENT,
+  PHASE_COUNT
+};
+
+// Nanoseconds since the first call.
+long long TraceNow();
+
+// Records one finished phase into the calling thread's ring buffer. Buffers
+// are pooled, so short-lived worker threads reuse them instead of piling up.
+void TraceEvent(TracePhase phase, long long start, long long end);
+
+// Times the enclosing block.
+struct TraceScope {
+  TracePhase phase;
+  long long start;
+
+  explicit TraceScope(TracePhase p) : phase(p), start(TRACING ? TraceNow() : 0) {}
+  ~TraceScope() {
+    if (TRACING) {
+      TraceEvent(phase, start, TraceNow());
+    }
+  }
+};
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto) of every buffered
+// event. Call once the worker threads are done.
+bool WriteChromeTrace(const char* path);
+
+// Per phase: count, mean, p50, p90, p99 and max in microseconds.
+void PrintTraceSummary(std::ostream& out);
+
+const char* TracePhaseName(TracePhase phase);
@@ -0,0 +1,221 @@
+#include "WeightMap.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ImageStats.hpp"
+#include "Random.hpp"
+
+constexpr int WEIGHT_FLOOR = 16;
+constexpr int SALIENCY_BLUR_RADIUS = 2;
+
+static void FinishWeightMap(WeightMap& map) {
+  map.cdf.resize(map.w.size());
+  long long total = 0;
+  for (size_t i = 0; i < map.w.size(); i++) {
+    total += map.w[i];
+    map.cdf[i] = total;
+  }
+}
+
+// Scales raw values to [WEIGHT_FLOOR, 255].
+static WeightMap NormalizeWeights(const std::vector<float>& raw, int width, int height) {
+  WeightMap map;
+  map.width = width;
+  map.height = height;
+  map.w.resize(raw.size());
+
+  float peak = std::max(*std::max_element(raw.begin(), raw.end()), 1e-6f);
+  for (size_t i = 0; i < raw.size(); i++) {
+    map.w[i] = (unsigned char)(WEIGHT_FLOOR + (255 - WEIGHT_FLOOR) * raw[i] / peak);
+  }
+
+  FinishWeightMap(map);
+  return map;
+}
+
+WeightMap BuildSobelWeights(Image original) {
+  int w = original.width;
+  int h = original.height;
+  const Color* px = Pixels(original);
+
+  std::vector<float> luma((size_t)w * h);
+  for (size_t i = 0; i < luma.size(); i++) {
+    luma[i] = 0.299f * px[i].r + 0.587f * px[i].g + 0.114f * px[i].b;
+  }
+
+  auto at = [&](int x, int y) {
+    return luma[std::clamp(y, 0, h - 1) * w + std::clamp(x, 0, w - 1)];
+  };
+
+  std::vector<float> raw((size_t)w * h);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      float gx = at(x + 1, y - 1) + 2 * at(x + 1, y) + at(x + 1, y + 1)
+               - at(x - 1, y - 1) - 2 * at(x - 1, y) - at(x - 1, y + 1);
+      float gy = at(x - 1, y + 1) + 2 * at(x, y + 1) + at(x + 1, y + 1)
+               - at(x - 1, y - 1) - 2 * at(x, y - 1) - at(x + 1, y - 1);
+      raw[y * w + x] = sqrtf(gx * gx + gy * gy);
+    }
+  }
+
+  return NormalizeWeights(raw, w, h);
+}
+
+WeightMap BuildSaliencyWeights(Image original) {
+  int w = original.width;
+  int h = original.height;
+  const Color* px = Pixels(original);
+
+  // Box blur through a 2D integral image per channel.
+  int stride = w + 1;
+  std::vector<long long> sat[3];
+  for (auto& s : sat) {
+    s.assign((size_t)stride * (h + 1), 0);
+  }
+  double mean[3] = {};
+  for (int y = 0; y < h; y++) {
+    long long row[3] = {};
+    for (int x = 0; x < w; x++) {
+      Color c = px[y * w + x];
+      int v[3] = {c.r, c.g, c.b};
+      for (int ch = 0; ch < 3; ch++) {
+        row[ch] += v[ch];
+        sat[ch][(y + 1) * stride + x + 1] = sat[ch][y * stride + x + 1] + row[ch];
+        mean[ch] += v[ch];
+      }
+    }
+  }
+  for (double& m : mean) {
+    m /= (double)w * h;
+  }
+
+  std::vector<float> raw((size_t)w * h);
+  for (int y = 0; y < h; y++) {
+    int y0 = std::max(y - SALIENCY_BLUR_RADIUS, 0), y1 = std::min(y + SALIENCY_BLUR_RADIUS + 1, h);
+    for (int x = 0; x < w; x++) {
+      int x0 = std::max(x - SALIENCY_BLUR_RADIUS, 0), x1 = std::min(x + SALIENCY_BLUR_RADIUS + 1, w);
+      double n = (double)(x1 - x0) * (y1 - y0);
+      double d2 = 0.0;
+      for (int ch = 0; ch < 3; ch++) {
+        const std::vector<long long>& s = sat[ch];
+        double blurred = (s[y1 * stride + x1] - s[y0 * stride + x1] - s[y1 * stride + x0] + s[y0 * stride + x0]) / n;
+        d2 += (blurred - mean[ch]) * (blurred - mean[ch]);
+      }
+      raw[y * w + x] = (float)sqrt(d2);
+    }
+  }
+
+  return NormalizeWeights(raw, w, h);
+}
+
+WeightMap LoadWeightMask(const char* path, int width, int height) {
+  Image mask = LoadImage(path);
+  if (mask.data == nullptr) {
+    TraceLog(LOG_WARNING, "WEIGHTS: Mask %s could not be loaded, ignoring it", path);
+    return WeightMap{};
+  }
+  ImageResize(&mask, width, height);
+  ImageFormat(&mask, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
+
+  WeightMap map;
+  map.width = width;
+  map.height = height;
+  const unsigned char* gray = (const unsigned char*)mask.data;
+  map.w.assign(gray, gray + (size_t)width * height);
+  UnloadImage(mask);
+
+  FinishWeightMap(map);
+  return map;
+}
+
+WeightMap BuildWeightMap(WeightSource source, Image original, const char* maskPath) {
+  switch (source) {
+    case WEIGHTS_SOBEL: return BuildSobelWeights(original);
+    case WEIGHTS_SALIENCY: return BuildSaliencyWeights(original);
+    case WEIGHTS_MASK: return LoadWeightMask(maskPath, original.width, original.height);
+    default: return WeightMap{};
+  }
+}
+
+WeightMap LoadRoiMask(const char* path, int width, int height) {
+  WeightMap roi = LoadWeightMask(path, width, height);
+  for (unsigned char& v : roi.w) {
+    v = v > 127 ? 1 : 0;
+  }
+
+  FinishWeightMap(roi);
+  return roi;
+}
+
+void ApplyRoi(WeightMap& weights, const WeightMap& roi) {
+  for (size_t i = 0; i < weights.w.size(); i++) {
+    if (roi.w[i] == 0) {
+      weights.w[i] = 0;
+    }
+  }
+
+  FinishWeightMap(weights);
+}
+
+void ClipSpansToMask(const WeightMap& mask, std::vector<Span>& spans) {
+  std::vector<Span> clipped;
+  clipped.reserve(spans.size());
+
+  for (const Span& s : spans) {
+    const unsigned char* row = &mask.w[s.y * mask.width];
+    int x = s.x0;
+    while (x < s.x1) {
+      while (x < s.x1 && row[x] == 0) x++;
+      int start = x;
+      while (x < s.x1 && row[x] != 0) x++;
+      if (start < x) {
+        clipped.push_back(Span{s.y, start, x});
+      }
+    }
+  }
+
+  spans.swap(clipped);
+}
+
+Color FillOutsideMask(const WeightMap& mask, Image original, Image* dst) {
+  const Color* org = Pixels(original);
+  long long sum[3] = {};
+  long long count = 0;
+
+  for (size_t i = 0; i < mask.w.size(); i++) {
+    if (mask.w[i] == 0) {
+      sum[0] += org[i].r;
+      sum[1] += org[i].g;
+      sum[2] += org[i].b;
+      count++;
+    }
+  }
+
+  Color mean = BLACK;
+  if (count > 0) {
+    mean = Color{(unsigned char)(sum[0] / count), (unsigned char)(sum[1] / count), (unsigned char)(sum[2] / count), 255};
+  }
+
+  Color* px = (Color*)dst->data;
+  for (size_t i = 0; i < mask.w.size(); i++) {
+    if (mask.w[i] == 0) {
+      px[i] = mean;
+    }
+  }
+
+  return mean;
+}
+
+bool SampleWeightedPoint(const WeightMap& map, int& x, int& y) {
+  if (map.cdf.empty() || map.cdf.back() == 0) {
+    return false;
+  }
+
+  long long target = RandLong(0, map.cdf.back() - 1);
+  size_t i = std::upper_bound(map.cdf.begin(), map.cdf.end(), target) - map.cdf.begin();
+
+  x = (int)(i % map.width);
+  y = (int)(i / map.width);
+  return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+
+#include "../include/raylib.h"
+#include "ImageStats.hpp"
+
+enum WeightSource {
+  WEIGHTS_NONE = 0,
+  WEIGHTS_SOBEL,
+  WEIGHTS_SALIENCY,
+  WEIGHTS_MASK,
+};
+
+// Per-pixel importance, 0-255, multiplied into every error sum. Computed maps
+// keep a floor so flat areas still get painted; a user mask may hold zeros,
+// and those pixels are never sampled or scored.
+struct WeightMap {
+  int width = 0;
+  int height = 0;
+  std::vector<unsigned char> w;
+  std::vector<long long> cdf; // running sum of w in row-major order
+};
+
+// Sobel gradient magnitude of the luma.
+WeightMap BuildSobelWeights(Image original);
+
+// Frequency-tuned saliency: distance of the locally blurred color from the
+// image mean.
+WeightMap BuildSaliencyWeights(Image original);
+
+// Grayscale image from disk, resized to width x height. Empty, with a
+// warning, when the file cannot be loaded.
+WeightMap LoadWeightMask(const char* path, int width, int height);
+
+WeightMap BuildWeightMap(WeightSource source, Image original, const char* maskPath);
+
+// Region of interest: weight 1 where the grayscale mask is above mid-gray, 0
+// elsewhere. Empty when the mask cannot be loaded.
+WeightMap LoadRoiMask(const char* path, int width, int height);
+
+// Zeroes the weights outside the region of interest.
+void ApplyRoi(WeightMap& weights, const WeightMap& roi);
+
+// Splits spans so only pixels with nonzero weight remain.
+void ClipSpansToMask(const WeightMap& mask, std::vector<Span>& spans);
+
+// Paints every zero-weight pixel of dst with the mean of those pixels in the
+// original. Returns the mean.
+Color FillOutsideMask(const WeightMap& mask, Image original, Image* dst);
+
+// Draws a pixel with probability proportional to its weight. Returns false
+// when every weight is zero.
+bool SampleWeightedPoint(const WeightMap& map, int& x, int& y);